@@ -0,0 +1,30 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Blocks start small so tiny programs stay cheap, then double up to a cap.
+static const size_t firstBlockSize = 16 * 1024;
+static const size_t maxBlockSize = 4 * 1024 * 1024;
+
+Arena::~Arena() {
+    for (char* block : blocks) free(block);
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    size_t blockSize = blocks.empty() ? firstBlockSize : min(maxBlockSize, reserved);
+    if (blockSize < size + align) blockSize = size + align;
+    char* block = static_cast<char*>(malloc(blockSize));
+    if (!block) throw bad_alloc();
+    blocks.push_back(block);
+    reserved += blockSize;
+    cursor = block;
+    limit = block + blockSize;
+    return allocate(size, align);
+}
+
+string_view Arena::copy(string_view text) {
+    char* p = static_cast<char*>(allocate(text.size(), 1));
+    memcpy(p, text.data(), text.size());
+    return string_view(p, text.size());
+}
@@ -0,0 +1,50 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Bump allocator that owns everything built for one compilation and frees
+// it in one shot when destroyed. Destructors never run, so only trivially
+// destructible objects may live here.
+struct Arena {
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (p + size > reinterpret_cast<uintptr_t>(limit)) return allocateSlow(size, align);
+        cursor = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+    }
+
+    // Copies text into the arena, for strings that do not live in the source
+    string_view copy(string_view text);
+
+    size_t blockCount() const { return blocks.size(); }
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    void* allocateSlow(size_t size, size_t align);
+
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t reserved = 0;
+    vector<char*> blocks;
+};
+
+#endif // ARENA_HPP
@@ -1,6 +1,10 @@
 from flask import Flask, request, jsonify, send_from_directory
+import ctypes
+import itertools
+import json
+import struct
 import subprocess
-import tempfile
+import threading
 import os
 from flask_cors import CORS
 
@@ -8,6 +12,139 @@ app = Flask(__name__)
 CORS(app)
 
 COMPILER_PATH = os.path.join(os.path.dirname(__file__), 'F4compiler_modular.exe')
+LIBRARY_PATH = os.path.join(os.path.dirname(__file__), 'libf4.so')
+# Every phase the playground shows, as one JSON document
+EMIT_OPTIONS = '--emit=tokens,ast,tac,asm'
+# Token types as the text report names them; the rest keep their names
+TOKEN_LABELS = {'INT': 'Keyword (int)', 'RETURN': 'Keyword (return)', 'IF': 'Keyword (if)',
+                'ELSE': 'Keyword (else)'}
+
+
+class CompilerServer:
+    """One resident `--serve` compiler shared by every request.
+
+    Requests are framed as little-endian (id, size) followed by an options
+    line and the source; responses as (id, status, size) and the report.
+    They come back in the order they finish, so a reader thread hands
+    each one to the request waiting on its id.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self.lock = threading.Lock()
+        self.ids = itertools.count()
+        self.process = None
+        self.waiting = {}
+
+    def _start(self):
+        self.process = subprocess.Popen([self.path, '--serve'], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+        threading.Thread(target=self._read, args=(self.process,), daemon=True).start()
+
+    def _read(self, process):
+        while True:
+            header = process.stdout.read(12)
+            if len(header) < 12:
+                break
+            request_id, status, size = struct.unpack('<III', header)
+            report = process.stdout.read(size)
+            with self.lock:
+                slot = self.waiting.pop(request_id, None)
+            if slot:
+                slot['result'] = (status, report.decode('utf-8', 'replace'))
+                slot['done'].set()
+        # The server died: fail whatever was still waiting on it
+        with self.lock:
+            if self.process is process:
+                self.process = None
+            waiting = [slot for slot in self.waiting.values() if slot['process'] is process]
+            self.waiting = {k: v for k, v in self.waiting.items() if v['process'] is not process}
+        for slot in waiting:
+            slot['done'].set()
+
+    def compile(self, source, options='', timeout=10):
+        payload = (options + '\n' + source).encode('utf-8')
+        with self.lock:
+            if self.process is None:
+                self._start()
+            request_id = next(self.ids) & 0xFFFFFFFF
+            slot = {'done': threading.Event(), 'result': None, 'process': self.process}
+            self.waiting[request_id] = slot
+            try:
+                self.process.stdin.write(struct.pack('<II', request_id, len(payload)) + payload)
+                self.process.stdin.flush()
+            except OSError:
+                self.waiting.pop(request_id, None)
+                raise RuntimeError('the compiler server is not running')
+        if not slot['done'].wait(timeout):
+            with self.lock:
+                self.waiting.pop(request_id, None)
+            raise TimeoutError('compilation timed out')
+        if slot['result'] is None:
+            raise RuntimeError('the compiler server exited')
+        return slot['result']
+
+
+class F4Options(ctypes.Structure):
+    _fields_ = [('optimize', ctypes.c_int), ('x86_64', ctypes.c_int), ('interpret', ctypes.c_int),
+                ('emit', ctypes.c_uint)]
+
+
+class CompilerLibrary:
+    """libf4 called in process, through the C interface in f4.h.
+
+    The library keeps no state, and ctypes lets go of the GIL for the
+    length of each call, so requests on different threads compile in
+    parallel. Takes the same option strings as CompilerServer. There is
+    no timeout: a call in process cannot be interrupted, and with no
+    --interpret every compile finishes.
+    """
+
+    OK, FAILED, TRUNCATED = 0, 1, 2
+    EMIT = {'tokens': 1, 'ast': 2, 'tac': 4, 'asm': 8}
+
+    def __init__(self, path):
+        self.library = ctypes.CDLL(path)
+        self.library.f4_compile.restype = ctypes.c_int
+        self.library.f4_compile.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(F4Options),
+                                            ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_size_t)]
+
+    def _options(self, text):
+        options = F4Options()
+        for option in text.split():
+            if option == '-O':
+                options.optimize = 1
+            elif option == '-m64':
+                options.x86_64 = 1
+            elif option == '--interpret':
+                options.interpret = 1
+            elif option.startswith('--emit='):
+                for phase in option[len('--emit='):].split(','):
+                    options.emit |= self.EMIT[phase]
+            else:
+                raise ValueError(f'unknown option {option!r}')
+        return options
+
+    def compile(self, source, options=''):
+        data = source.encode('utf-8')
+        options = self._options(options)
+        size = ctypes.c_size_t()
+        # Most reports fit the first buffer; a larger one is retried at
+        # the size the library asks for
+        capacity = 64 * 1024
+        while True:
+            output = ctypes.create_string_buffer(capacity)
+            result = self.library.f4_compile(data, len(data), ctypes.byref(options), output, capacity,
+                                             ctypes.byref(size))
+            if result != self.TRUNCATED:
+                break
+            capacity = size.value
+        if result not in (self.OK, self.FAILED):
+            raise RuntimeError('libf4 could not compile the request')
+        return result, output.raw[:size.value].decode('utf-8', 'replace')
+
+
+# In process when the library has been built, else through a resident server
+compiler = CompilerLibrary(LIBRARY_PATH) if os.path.exists(LIBRARY_PATH) else CompilerServer(COMPILER_PATH)
 
 @app.route('/')
 def index():
@@ -22,54 +159,27 @@ def compile_code():
     code = request.json.get('code', '')
     if not code.strip():
         return jsonify({'error': 'No code provided.'}), 400
-    with tempfile.NamedTemporaryFile(delete=False, suffix='.c', mode='w', dir=os.path.dirname(__file__)) as tmp:
-        tmp.write(code)
-        tmp_path = tmp.name
     try:
-        result = subprocess.run([COMPILER_PATH, tmp_path], capture_output=True, text=True, timeout=10)
-        output = result.stdout
-        print("COMPILER OUTPUT:")
-        print(output)
-        # Improved section extraction
-        def extract_section(name, text):
-            import re
-            # Match section header (with possible leading/trailing whitespace)
-            pattern = re.compile(rf"^\s*{re.escape(name)}\s*$", re.MULTILINE)
-            match = pattern.search(text)
-            if not match:
-                return ''
-            start = match.end()
-            # Find the next section header or end of text
-            next_header = re.compile(r"^\s*===.*===\s*$", re.MULTILINE)
-            next_match = next_header.search(text, start)
-            end = next_match.start() if next_match else len(text)
-            return text[start:end].strip()
-        tokens = extract_section('=== Lexical Analysis (Tokenization) ===', output)
-        ast = extract_section('=== Syntax Analysis (Parsing) ===', output)
-        semantic = extract_section('=== Semantic Analysis ===', output)
-        tac = extract_section('=== Intermediate Code Generation ===', output)
-        asm = extract_section('=== Assembly Code Generation ===', output)
-        print("TOKENS SECTION:")
-        print(tokens)
-        print("AST SECTION:")
-        print(ast)
-        print("SEMANTIC SECTION:")
-        print(semantic)
-        print("TAC SECTION:")
-        print(tac)
-        print("ASM SECTION:")
-        print(asm)
-        return jsonify({
-            'tokens': tokens,
-            'ast': ast,
-            'semantic': semantic,
-            'tac': tac,
-            'asm': asm
-        })
+        _, output = compiler.compile(code, EMIT_OPTIONS)
+        result = json.loads(output)
+        sections = {
+            'tokens': '\n'.join('Line {}, Column {}: {} = {}'.format(
+                token['line'], token['column'], TOKEN_LABELS.get(token['type'], token['type']), token['value'])
+                for token in result.get('tokens', [])),
+            'ast': json.dumps(result['ast'], indent=2) if 'ast' in result else '',
+            'semantic': 'Semantic analysis passed!' if 'tac' in result else '',
+            'tac': '\n'.join(f'{i}: {line}' for i, line in enumerate(result.get('tac', []))),
+            'asm': '\n'.join(f'{i}: {line}' for i, line in enumerate(result.get('asm', []))),
+        }
+        # Errors go in the section of the phase they stopped, after
+        # whatever it had shown, as in the text report
+        if result['errors']:
+            failed = result['failed']
+            shown = sections[failed] + '\n\n' if sections[failed] else ''
+            sections[failed] = shown + 'Compilation errors:\n' + '\n'.join(result['errors'])
+        return jsonify(sections)
     except Exception as e:
         return jsonify({'error': str(e)}), 500
-    finally:
-        os.remove(tmp_path)
 
 if __name__ == '__main__':
     app.run(debug=True, port=5000) 
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "batch.hpp"
+#include "source.hpp"
+#include "threadpool.hpp"
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+struct FileResult {
+    int status = 0;
+    size_t bytes = 0; // of source
+    string error;     // why the file could not be compiled at all
+};
+
+static string outputPath(const string& path, bool json) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    size_t stem = dot != string::npos && (slash == string::npos || dot > slash + 1) ? dot : path.size();
+    return path.substr(0, stem) + (json ? ".json" : ".out");
+}
+
+// The file a path names, for telling whether two paths are one file: its
+// directory resolved, so that ./a.c, a.c and a link to the directory
+// agree, then its name. Falls back to the path when the directory is gone.
+static string identity(const string& path) {
+    size_t slash = path.find_last_of('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    char resolved[PATH_MAX];
+    if (!realpath(directory.c_str(), resolved)) return path;
+    string file(resolved);
+    if (file.back() != '/') file += '/';
+    return file + path.substr(slash == string::npos ? 0 : slash + 1);
+}
+
+// Reports written over one another, or over a source of the batch, would
+// lose results or inputs: refuse the batch before compiling anything
+static bool checkOutputs(const vector<string>& paths, bool json) {
+    unordered_map<string, size_t> sources;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto [first, added] = sources.emplace(identity(paths[i]), i);
+        if (!added) {
+            cerr << "Error: '" << paths[i] << "' is listed twice, also as '" << paths[first->second] << "'" << endl;
+            return false;
+        }
+    }
+    unordered_map<string, size_t> outputs;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        string output = outputPath(paths[i], json);
+        string file = identity(output);
+        auto source = sources.find(file);
+        if (source != sources.end() && source->second == i) {
+            cerr << "Error: The report of '" << paths[i] << "' would overwrite the source itself" << endl;
+            return false;
+        }
+        if (source != sources.end()) {
+            cerr << "Error: The report of '" << paths[i] << "' would overwrite the source '" << paths[source->second]
+                 << "'" << endl;
+            return false;
+        }
+        auto [first, added] = outputs.emplace(file, i);
+        if (!added) {
+            cerr << "Error: '" << paths[first->second] << "' and '" << paths[i] << "' would both write '" << output
+                 << "'" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int compileBatch(const vector<string>& paths, const CompileOptions& options) {
+    if (!checkOutputs(paths, options.emit != 0)) return 1;
+    CompileOptions fileOptions = pooledOptions(options);
+    vector<FileResult> results(paths.size());
+
+    auto start = chrono::steady_clock::now();
+    parallelFor(paths.size(), 0, [&](size_t i) {
+        FileResult& result = results[i];
+        SourceFile source;
+        if (!source.open(paths[i])) {
+            result.status = 1;
+            result.error = "could not open the file";
+            return;
+        }
+        result.bytes = source.text().size();
+        string reportPath = outputPath(paths[i], options.emit != 0);
+        ofstream report(reportPath, ios::binary);
+        if (report) result.status = compile(source.text(), fileOptions, report);
+        report.close();
+        if (!report) {
+            result.status = 1;
+            result.error = "could not write '" + reportPath + "'";
+        }
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0, bytes = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const FileResult& result = results[i];
+        bytes += result.bytes;
+        if (result.status == 0) continue;
+        failed++;
+        if (!result.error.empty()) cerr << paths[i] << ": " << result.error << '\n';
+        else cerr << paths[i] << ": failed, see '" << outputPath(paths[i], options.emit != 0) << "'\n";
+    }
+    cout << fixed << setprecision(1) << "Compiled " << paths.size() - failed << " of " << paths.size() << " files in " << seconds * 1e3
+         << " ms";
+    // No rate to speak of for an empty manifest
+    if (!paths.empty()) cout << ": " << paths.size() / seconds << " files/s, " << bytes / seconds / 1e6 << " MB/s";
+    cout << endl;
+    return failed ? 1 : 0;
+}
+
+bool readManifest(const string& path, vector<string>& paths) {
+    ifstream manifest(path);
+    if (!manifest) return false;
+    size_t slash = path.find_last_of('/');
+    string directory = slash == string::npos ? string() : path.substr(0, slash + 1);
+    string line;
+    while (getline(manifest, line)) {
+        // Trailing blanks, and the \r of a CRLF manifest, are not part of a path
+        while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#') continue;
+        line.erase(0, first);
+        paths.push_back(line[0] == '/' ? line : directory + line);
+    }
+    return !manifest.bad();
+}
@@ -0,0 +1,24 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+#include "pipeline.hpp"
+using namespace std;
+
+// Compiles every source in paths at once on a work-stealing pool sized
+// to the machine. Each report goes to a file beside its source, named
+// for it with the extension .out, or .json under --emit; a batch where a
+// source is listed twice, two sources share a report, or a report would
+// overwrite a source, is refused whole. Lists the files that failed, then
+// the throughput in files/s and MB/s of source. Returns 0 when every file
+// compiled, 1 otherwise. options.run is not supported: runs fork, which
+// is not safe from the pool's threads.
+int compileBatch(const vector<string>& paths, const CompileOptions& options);
+
+// Appends the sources a manifest lists, one per line, taken relative to
+// the manifest's own directory. Blank lines and lines starting with '#'
+// are skipped. False when the manifest cannot be read.
+bool readManifest(const string& path, vector<string>& paths);
+
+#endif // BATCH_HPP
@@ -0,0 +1,61 @@
+// Code size benchmark for the back end: compiles a generated corpus of
+// arithmetic- and branch-heavy programs, with and without -O, and counts
+// the instructions in the assembly, how many of them touch memory and how
+// many are idiv, which costs some 20-40 cycles.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. codegen_bench.cpp $(ls ../*.cpp | grep -v main.cpp) -o codegen_bench
+#include "generator.hpp"
+#include "optimizer.hpp"
+#include <cstdio>
+#include <string>
+
+static const int programCount = 200;
+
+struct Counts {
+    size_t instructions = 0;
+    size_t memoryOperands = 0;
+    size_t divisions = 0;
+};
+
+static bool compile(const string& source, bool optimizeCode, Counts& counts) {
+    IRModule module;
+    if (!frontEnd(source, module)) return false;
+    if (optimizeCode) {
+        OptimizationReport report;
+        optimize(module, report);
+    }
+    vector<string> asmCode;
+    generateAssembly(module, Target::X86, asmCode);
+
+    // Instructions are the indented lines of the text section
+    bool text = false;
+    for (const string& line : asmCode) {
+        if (line == "section .text") text = true;
+        if (!text || line.compare(0, 4, "    ") != 0) continue;
+        if (line.compare(4, 7, "global ") == 0 || line.compare(4, 7, "extern ") == 0) continue;
+        counts.instructions++;
+        if (line.find('[') != string::npos) counts.memoryOperands++;
+        if (line.compare(4, 5, "idiv ") == 0) counts.divisions++;
+    }
+    return true;
+}
+
+int main() {
+    // Every precedence level, weighted towards the arithmetic that -O
+    // and the back end's idioms work on
+    ProgramShape shape;
+    shape.operators = {"+", "-", "*", "/", "+", "*", "<", "==", "-", ">="};
+    shape.maxTerms = 9;
+    vector<string> corpus = Generator(12345, shape).corpus(programCount);
+
+    printf("%-6s %10s %12s %12s %10s\n", "mode", "programs", "instructions", "memory ops", "idiv");
+    for (bool optimizeCode : {false, true}) {
+        Counts counts;
+        for (const string& source : corpus) {
+            if (!compile(source, optimizeCode, counts)) return 1;
+        }
+        printf("%-6s %10d %12zu %12zu %10zu\n", optimizeCode ? "-O" : "-O0", programCount, counts.instructions,
+               counts.memoryOperands, counts.divisions);
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Cost of reporting a compile: the full text report against the JSON
+// document of --emit, with every phase and with only some of them. Each
+// path writes to a stream that discards the bytes, so what is measured
+// is the pipeline and the formatting, not the terminal.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. emit_bench.cpp $(ls ../*.cpp | grep -v main.cpp) -o emit_bench
+#include "pipeline.hpp"
+#include "generator.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using Clock = chrono::steady_clock;
+
+static const int programCount = 500;
+static const int repeats = 5;
+
+// Counts what is written and keeps none of it
+struct CountingBuffer : streambuf {
+    size_t bytes = 0;
+    int overflow(int c) override {
+        bytes++;
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize count) override {
+        bytes += count;
+        return count;
+    }
+};
+
+static void measure(const char* path, const vector<string>& corpus, const CompileOptions& options) {
+    CountingBuffer sink;
+    ostream out(&sink);
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const string& source : corpus) compile(source, options, out);
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    size_t compiles = corpus.size() * repeats;
+    printf("%-28s %12.1f %14zu\n", path, seconds * 1e6 / compiles, sink.bytes / compiles);
+}
+
+int main() {
+    // Some dozens of statements, with strings and short nested ifs
+    ProgramShape shape;
+    shape.operators = {"+", "-", "*", "<", "==", ">="};
+    shape.minVariables = shape.maxVariables = 2;
+    shape.minStatements = 20;
+    shape.maxStatements = 59;
+    shape.maxTerms = 3;
+    shape.assignments = 3;
+    shape.printfs = 1;
+    shape.ifs = 1;
+    shape.maxDepth = 1;
+    vector<string> corpus = Generator(12345, shape).corpus(programCount);
+    printf("%-28s %12s %14s\n", "output", "us/compile", "bytes/compile");
+
+    CompileOptions options = pooledOptions(CompileOptions());
+    measure("text report", corpus, options);
+    options.emit = EmitTokens | EmitAst | EmitTac | EmitAsm;
+    measure("--emit=tokens,ast,tac,asm", corpus, options);
+    options.emit = EmitTac | EmitAsm;
+    measure("--emit=tac,asm", corpus, options);
+    options.emit = EmitTac;
+    measure("--emit=tac", corpus, options);
+    options.emit = EmitTokens;
+    measure("--emit=tokens", corpus, options);
+    return 0;
+}
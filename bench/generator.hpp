@@ -0,0 +1,119 @@
+// Generated corpora for the benchmarks: random programs made of a main()
+// over a few int variables, with assignments, printf calls and nested
+// if/else, shaped by ProgramShape. Each benchmark picks the shape that
+// stresses what it measures, then keeps only the measuring.
+#ifndef BENCH_GENERATOR_HPP
+#define BENCH_GENERATOR_HPP
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic.hpp"
+#include "codegen.hpp"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+struct ProgramShape {
+    // Binary operators drawn for expressions; repeating one makes it more
+    // frequent. The right side of / and % is always a nonzero constant.
+    vector<const char*> operators = {"+", "-", "*", "/", "%", "<", "==", ">="};
+    int minVariables = 3, maxVariables = 8;
+    int minStatements = 10, maxStatements = 29; // at the top level
+    int maxTerms = 7;                           // operands in an assignment
+    // Statement mix, as relative weights. An if past maxDepth becomes an
+    // assignment.
+    int assignments = 5, printfs = 2, ifs = 3;
+    int maxDepth = 3;
+    // A printf of the first two variables before the return, so that
+    // values are live to the end even with no printfs in the mix
+    bool printAtEnd = false;
+};
+
+struct Generator {
+    mt19937 rng;
+    ProgramShape shape;
+    vector<string> names;
+
+    explicit Generator(uint32_t seed, ProgramShape shape = ProgramShape()) : rng(seed), shape(move(shape)) {}
+
+    int pick(int n) { return static_cast<int>(rng() % n); }
+    int between(int low, int high) { return low + pick(high - low + 1); }
+
+    string operand() {
+        if (pick(3) == 0) return to_string(pick(100));
+        return names[pick(names.size())];
+    }
+
+    // Left-associated chains, so that every precedence level in the set
+    // gets mixed
+    string expression(int terms) {
+        string text = operand();
+        for (int i = 1; i < terms; ++i) {
+            const char* op = shape.operators[pick(shape.operators.size())];
+            text += string(" ") + op + " ";
+            text += op[0] == '/' || op[0] == '%' ? to_string(1 + pick(9)) : operand();
+        }
+        return text;
+    }
+
+    void statements(string& out, int depth, int count) {
+        for (int i = 0; i < count; ++i) {
+            int kind = pick(shape.assignments + shape.printfs + shape.ifs);
+            if (kind < shape.assignments || (kind >= shape.assignments + shape.printfs && depth >= shape.maxDepth)) {
+                out += names[pick(names.size())] + " = " + expression(between(2, shape.maxTerms)) + ";\n";
+            } else if (kind < shape.assignments + shape.printfs) {
+                out += "printf(\"%d %d\\n\", " + expression(between(1, 4)) + ", " + operand() + ");\n";
+            } else {
+                out += "if (" + expression(between(1, 5)) + ") {\n";
+                statements(out, depth + 1, between(1, 4));
+                out += "} else {\n";
+                statements(out, depth + 1, pick(4));
+                out += "}\n";
+            }
+        }
+    }
+
+    string program() {
+        names.clear();
+        string out = "int main() {\n";
+        int vars = between(max(shape.minVariables, 2), shape.maxVariables);
+        for (int i = 0; i < vars; ++i) {
+            names.push_back("v" + to_string(i));
+            out += "int " + names.back() + " = " + to_string(pick(50)) + ";\n";
+        }
+        statements(out, 0, between(shape.minStatements, shape.maxStatements));
+        if (shape.printAtEnd) out += "printf(\"%d %d\\n\", " + names[0] + ", " + names[1] + ");\n";
+        out += "return " + expression(3) + ";\n}\n";
+        return out;
+    }
+
+    vector<string> corpus(int count) {
+        vector<string> programs;
+        for (int i = 0; i < count; ++i) programs.push_back(program());
+        return programs;
+    }
+};
+
+// The front end for one generated program, down to unoptimized
+// intermediate code. The module keeps views into source, which must
+// outlive it. False, after printing the first error and the program,
+// when it does not compile.
+inline bool frontEnd(const string& source, IRModule& module) {
+    TokenStream tokens;
+    vector<string> errors;
+    tokenize(source, tokens, errors);
+    size_t index = 0;
+    Arena arena;
+    ASTNode* ast = parseProgram(tokens, index, arena, errors);
+    SymbolTable symbols;
+    if (errors.empty()) semanticAnalysis(ast, symbols, errors);
+    if (!errors.empty()) {
+        fprintf(stderr, "%s\n%s\n", errors[0].c_str(), source.c_str());
+        return false;
+    }
+    generateIntermediateCode(ast, module);
+    return true;
+}
+
+#endif // BENCH_GENERATOR_HPP
@@ -0,0 +1,100 @@
+// Throughput of producing a linkable object from finished machine code:
+// the built-in encoder and ELF writer against NASM text, and against
+// that text plus a run of nasm when nasm is on the PATH. The programs
+// come from a generated corpus compiled for x86-64 once, up front.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. object_bench.cpp $(ls ../*.cpp | grep -v main.cpp) -o object_bench
+#include "generator.hpp"
+#include "peephole.hpp"
+#include "encoder.hpp"
+#include "elf.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using Clock = chrono::steady_clock;
+
+static const int programCount = 200;
+static const int repeats = 20;
+
+struct Compiled {
+    IRModule module;
+    vector<MFunction> functions;
+};
+
+static bool compile(const string& source, Compiled& compiled) {
+    if (!frontEnd(source, compiled.module)) return false;
+    generateMachineCode(compiled.module, Target::X64, compiled.functions);
+    PeepholeReport report;
+    peephole(compiled.functions, report);
+    return true;
+}
+
+static void report(const char* path, double seconds, size_t bytes, int programs) {
+    printf("%-22s %10.3f %12.1f %10.1f\n", path, seconds * 1e3, seconds * 1e6 / programs, bytes / seconds / 1e6);
+}
+
+int main() {
+    // Straight-line arithmetic, calls and nested ifs over a few variables
+    vector<string> corpus = Generator(12345).corpus(programCount);
+    vector<Compiled> programs(programCount);
+    for (int i = 0; i < programCount; ++i) {
+        if (!compile(corpus[i], programs[i])) return 1;
+    }
+
+    printf("%-22s %10s %12s %10s\n", "path", "total ms", "us/program", "MB/s out");
+    size_t bytes = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const Compiled& program : programs) {
+            MachineCode code;
+            encodeModule(program.module, program.functions, code);
+            vector<uint8_t> object;
+            writeObject(program.module, code, object);
+            bytes += object.size();
+        }
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    report("encoder + ELF", seconds, bytes, programCount * repeats);
+
+    bytes = 0;
+    start = Clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const Compiled& program : programs) {
+            vector<string> asmCode;
+            formatAssembly(program.module, program.functions, asmCode);
+            for (const string& line : asmCode) bytes += line.size() + 1;
+        }
+    }
+    seconds = chrono::duration<double>(Clock::now() - start).count();
+    report("NASM text", seconds, bytes, programCount * repeats);
+
+    // Text written out and assembled once per program, as main.cpp's
+    // users do today
+    if (system("command -v nasm > /dev/null 2>&1") != 0) {
+        printf("%-22s %10s\n", "NASM text + nasm", "(nasm not found)");
+        return 0;
+    }
+    bytes = 0;
+    start = Clock::now();
+    for (const Compiled& program : programs) {
+        vector<string> asmCode;
+        formatAssembly(program.module, program.functions, asmCode);
+        FILE* file = fopen("object_bench.asm", "w");
+        if (!file) return 1;
+        for (const string& line : asmCode) fprintf(file, "%s\n", line.c_str());
+        fclose(file);
+        if (system("nasm -f elf64 -o object_bench.o object_bench.asm") != 0) return 1;
+        FILE* object = fopen("object_bench.o", "rb");
+        if (!object) return 1;
+        fseek(object, 0, SEEK_END);
+        bytes += ftell(object);
+        fclose(object);
+    }
+    seconds = chrono::duration<double>(Clock::now() - start).count();
+    report("NASM text + nasm", seconds, bytes, programCount);
+    remove("object_bench.asm");
+    remove("object_bench.o");
+    return 0;
+}
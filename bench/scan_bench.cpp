@@ -0,0 +1,133 @@
+// Microbenchmark for the lexer's byte-scanning kernels: runs every kernel
+// set the CPU supports over whitespace-, comment-, string- and newline-heavy
+// buffers, driven the way the lexer drives them.
+//
+//   g++ -std=c++17 -O2 -I.. scan_bench.cpp ../scan.cpp -o scan_bench
+#include "scan.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+using Clock = chrono::steady_clock;
+
+static const size_t bufferSize = 16 << 20;
+static const int repeats = 5;
+
+// Whitespace runs of 1-64 bytes separated by single identifier bytes
+static string makeWhitespace(mt19937& rng) {
+    string s;
+    while (s.size() < bufferSize) {
+        s.append(1 + rng() % 64, " \t\n"[rng() % 3]);
+        s += 'x';
+    }
+    return s;
+}
+
+// Comment bodies of 16-512 bytes, each closed by "*/"
+static string makeComments(mt19937& rng) {
+    string s;
+    while (s.size() < bufferSize) {
+        size_t length = 16 + rng() % 496;
+        for (size_t i = 0; i < length; ++i) s += "abc *x\n "[rng() % 8];
+        s += "*/";
+    }
+    return s;
+}
+
+// String bodies of 8-256 bytes with occasional escapes, each closed by '"'
+static string makeStrings(mt19937& rng) {
+    string s;
+    while (s.size() < bufferSize) {
+        size_t length = 8 + rng() % 248;
+        for (size_t i = 0; i < length; ++i) {
+            if (rng() % 32 == 0) s += "\\n";
+            else s += static_cast<char>('a' + rng() % 26);
+        }
+        s += '"';
+    }
+    return s;
+}
+
+// Source-like lines of 1-80 bytes
+static string makeLines(mt19937& rng) {
+    string s;
+    while (s.size() < bufferSize) {
+        s.append(1 + rng() % 80, 'x');
+        s += '\n';
+    }
+    return s;
+}
+
+static size_t runWhitespace(const ScanKernels& k, const string& s) {
+    const char* p = s.data();
+    const char* end = p + s.size();
+    size_t items = 0;
+    while (p < end) {
+        p = k.skipSpace(p, end) + 1;
+        items++;
+    }
+    return items;
+}
+
+static size_t runComments(const ScanKernels& k, const string& s) {
+    const char* p = s.data();
+    const char* end = p + s.size();
+    size_t items = 0;
+    while (p < end) {
+        p = k.findCommentEnd(p, end) + 2;
+        items++;
+    }
+    return items;
+}
+
+static size_t runStrings(const ScanKernels& k, const string& s) {
+    const char* p = s.data();
+    const char* end = p + s.size();
+    size_t items = 0;
+    while ((p = k.findQuoteOrEscape(p, end)) < end) {
+        p += *p == '"' ? 1 : 2;
+        items++;
+    }
+    return items;
+}
+
+static size_t runLines(const ScanKernels& k, const string& s) {
+    vector<uint32_t> starts;
+    starts.reserve(s.size() / 8);
+    k.collectLineStarts(s.data(), s.data() + s.size(), starts);
+    return starts.size();
+}
+
+int main() {
+    mt19937 rng(12345);
+    struct Workload {
+        const char* name;
+        string data;
+        size_t (*run)(const ScanKernels&, const string&);
+    } workloads[] = {
+        {"whitespace", makeWhitespace(rng), runWhitespace},
+        {"comments", makeComments(rng), runComments},
+        {"strings", makeStrings(rng), runStrings},
+        {"line starts", makeLines(rng), runLines},
+    };
+
+    vector<const ScanKernels*> kernels = availableScanKernels();
+    printf("%-12s %-8s %10s %10s %8s\n", "workload", "kernels", "MB/s", "items", "speedup");
+    for (const auto& workload : workloads) {
+        double scalarSeconds = 0;
+        for (const ScanKernels* k : kernels) {
+            double best = 1e9;
+            size_t items = 0;
+            for (int r = 0; r < repeats; ++r) {
+                auto start = Clock::now();
+                items = workload.run(*k, workload.data);
+                best = min(best, chrono::duration<double>(Clock::now() - start).count());
+            }
+            if (k == kernels.front()) scalarSeconds = best;
+            printf("%-12s %-8s %10.0f %10zu %7.2fx\n", workload.name, k->name,
+                   workload.data.size() / best / 1e6, items, scalarSeconds / best);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Requests per second through --serve against starting the compiler once
+// per request, as backend.py does, and against compile() called in
+// process on one thread, the ceiling for a single core. The programs are
+// small generated ones, like those typed into the playground.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. serve_bench.cpp $(ls ../*.cpp | grep -v main.cpp) -o serve_bench
+//   ./serve_bench <path to the compiler>
+#include "pipeline.hpp"
+#include "generator.hpp"
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using Clock = chrono::steady_clock;
+
+static const int programCount = 2000;
+static const int spawnCount = 200;
+
+static void putLE(string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>(value >> 8 * i);
+}
+
+static void report(const char* path, double seconds, int requests) {
+    printf("%-28s %10.1f %12.0f\n", path, seconds * 1e6 / requests, requests / seconds);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <path to the compiler>\n", argv[0]);
+        return 1;
+    }
+    const char* compiler = argv[1];
+    // A handful of statements over two variables
+    ProgramShape shape;
+    shape.operators = {"+", "-", "*", "<", "=="};
+    shape.minVariables = shape.maxVariables = 2;
+    shape.minStatements = 2;
+    shape.maxStatements = 7;
+    shape.maxTerms = 3;
+    shape.assignments = 3;
+    shape.printfs = 0;
+    shape.ifs = 1;
+    shape.maxDepth = 1;
+    vector<string> corpus = Generator(12345, shape).corpus(programCount);
+    printf("%-28s %10s %12s\n", "path", "us/request", "requests/s");
+
+    CompileOptions options = pooledOptions(CompileOptions());
+    Clock::time_point start = Clock::now();
+    for (const string& source : corpus) {
+        ostringstream out;
+        compile(source, options, out);
+    }
+    report("compile(), 1 thread", chrono::duration<double>(Clock::now() - start).count(), programCount);
+
+    // Every request written up front by one thread while this one reads
+    // the responses back
+    int toServer[2], fromServer[2];
+    if (pipe(toServer) != 0 || pipe(fromServer) != 0) return 1;
+    // Children must not inherit, and flush again, what is buffered here
+    fflush(stdout);
+    start = Clock::now();
+    pid_t server = fork();
+    if (server == 0) {
+        dup2(toServer[0], STDIN_FILENO);
+        dup2(fromServer[1], STDOUT_FILENO);
+        close(toServer[0]);
+        close(toServer[1]);
+        close(fromServer[0]);
+        close(fromServer[1]);
+        execl(compiler, compiler, "--serve", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(toServer[0]);
+    close(fromServer[1]);
+    thread writer([&] {
+        string requests;
+        for (int i = 0; i < programCount; ++i) {
+            putLE(requests, i);
+            putLE(requests, corpus[i].size() + 1);
+            requests += '\n' + corpus[i];
+        }
+        for (size_t at = 0; at < requests.size();) {
+            ssize_t count = write(toServer[1], requests.data() + at, requests.size() - at);
+            if (count <= 0) break;
+            at += count;
+        }
+        close(toServer[1]);
+    });
+    size_t bytes = 0;
+    char buffer[65536];
+    for (ssize_t count; (count = read(fromServer[0], buffer, sizeof(buffer))) > 0;) bytes += count;
+    writer.join();
+    close(fromServer[0]);
+    int status = 0;
+    waitpid(server, &status, 0);
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    // Each response is at least its 12-byte header
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || bytes < 12u * programCount) {
+        fprintf(stderr, "--serve failed\n");
+        return 1;
+    }
+    string label = "--serve, " + to_string(thread::hardware_concurrency()) + " threads";
+    report(label.c_str(), seconds, programCount);
+
+    // A temporary file and a fresh process per request
+    start = Clock::now();
+    for (int i = 0; i < spawnCount; ++i) {
+        const char* path = "serve_bench.c";
+        FILE* file = fopen(path, "w");
+        if (!file) return 1;
+        fputs(corpus[i].c_str(), file);
+        fclose(file);
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            freopen("/dev/null", "w", stdout);
+            execl(compiler, compiler, path, static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        waitpid(child, &status, 0);
+    }
+    report("process per request", chrono::duration<double>(Clock::now() - start).count(), spawnCount);
+    remove("serve_bench.c");
+    return 0;
+}
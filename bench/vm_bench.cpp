@@ -0,0 +1,81 @@
+// Dispatch cost of the bytecode interpreter: generated programs are
+// compiled to bytecode once, then interpreted over and over, and the time
+// is divided by the bytecode instructions actually executed. Bytecode
+// compilation is timed separately. Build a second time with
+// -DF4_VM_SWITCH to compare against plain switch dispatch.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. vm_bench.cpp $(ls ../*.cpp | grep -v main.cpp) -o vm_bench
+#include "generator.hpp"
+#include "vm.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+using Clock = chrono::steady_clock;
+
+static const int programCount = 200;
+static const int repeats = 200;
+
+static bool measure(const vector<IRModule>& modules) {
+    vector<BytecodeProgram> programs(modules.size());
+    string error;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < modules.size(); ++i) {
+        if (!compileBytecode(modules[i], programs[i], error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+    }
+    double compileSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    size_t instructions = 0;
+    start = Clock::now();
+    // Each program repeatedly while its code is in cache, so that what is
+    // measured is dispatch rather than memory traffic
+    for (const BytecodeProgram& program : programs) {
+        for (int r = 0; r < repeats; ++r) {
+            InterpretResult result;
+            interpret(program, result);
+            if (!result.completed) {
+                fprintf(stderr, "%s\n", result.error.c_str());
+                return false;
+            }
+            instructions += result.instructions;
+        }
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    size_t size = 0;
+    for (const BytecodeProgram& program : programs) size += program.functions[program.entry].code.size();
+    printf("%10zu %12.2f %12.2f %10zu %10.2f\n", size / programs.size(), compileSeconds * 1e6 / programs.size(),
+           seconds * 1e6 / (programs.size() * repeats), instructions / (programs.size() * repeats),
+           seconds * 1e9 / instructions);
+    return true;
+}
+
+int main() {
+    // Long runs of arithmetic with short nested ifs, so that most of the
+    // code is executed; a single printf at the end keeps the values live
+    // without letting formatting dominate
+    ProgramShape shape;
+    shape.minStatements = 100;
+    shape.maxStatements = 199;
+    shape.assignments = 8;
+    shape.printfs = 0;
+    shape.ifs = 2;
+    shape.printAtEnd = true;
+    // The modules keep views into their sources
+    vector<string> corpus = Generator(12345, shape).corpus(programCount);
+    // Unoptimized: with no input, -O folds these programs down to their
+    // result
+    vector<IRModule> modules(programCount);
+    for (int i = 0; i < programCount; ++i) {
+        if (!frontEnd(corpus[i], modules[i])) return 1;
+    }
+#ifdef F4_VM_SWITCH
+    printf("switch dispatch\n");
+#else
+    printf("threaded dispatch\n");
+#endif
+    printf("%10s %12s %12s %10s %10s\n", "bytecode", "compile us", "run us", "executed", "ns/instr");
+    return measure(modules) ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#include "cfg.hpp"
+#include <algorithm>
+
+bool BasicBlock::fallsThrough() const {
+    if (code.empty()) return true;
+    Opcode last = code.back().op;
+    return last != Opcode::Goto && last != Opcode::Return;
+}
+
+bool ControlFlowGraph::dominates(uint32_t a, uint32_t b) const {
+    if (!reachable(a) || !reachable(b)) return false;
+    return blocks[a].domEnter <= blocks[b].domEnter && blocks[b].domExit <= blocks[a].domExit;
+}
+
+static bool isJump(Opcode op) {
+    return op == Opcode::IfNot || op == Opcode::Goto || op == Opcode::Return;
+}
+
+// The label operand of a block's final jump
+static Operand& jumpTarget(Quad& quad) {
+    return quad.op == Opcode::IfNot ? quad.b : quad.a;
+}
+
+void buildCFG(IRFunction& function, ControlFlowGraph& cfg) {
+    cfg = ControlFlowGraph();
+    vector<BasicBlock>& blocks = cfg.blocks;
+    vector<uint32_t> labelBlock(function.labels.size(), noBlock);
+
+    // A label starts a block, a jump ends one. The entry block never gets a
+    // label, so nothing can branch back to it.
+    blocks.emplace_back();
+    bool open = true;
+    for (const Quad& quad : function.code) {
+        if (quad.op == Opcode::Label) {
+            const BasicBlock& current = blocks.back();
+            if (!open || blocks.size() == 1 || !current.code.empty() || !current.label.isNone()) blocks.emplace_back();
+            blocks.back().label = quad.a;
+            labelBlock[quad.a.id()] = blocks.size() - 1;
+            open = true;
+            continue;
+        }
+        if (!open) blocks.emplace_back();
+        blocks.back().code.push_back(quad);
+        open = !isJump(quad.op);
+    }
+    if (!blocks.back().code.empty() && blocks.back().code.back().op == Opcode::IfNot) blocks.emplace_back();
+    function.code.clear();
+
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        BasicBlock& block = blocks[b];
+        uint32_t next = b + 1 < blocks.size() ? b + 1 : noBlock;
+        if (!block.code.empty() && block.code.back().op == Opcode::IfNot) {
+            uint32_t target = labelBlock[block.code.back().b.id()];
+            if (target == next) {
+                // Both ways lead to the same place
+                block.code.pop_back();
+            } else {
+                block.succs = {next, target};
+            }
+        }
+        if (block.succs.empty()) {
+            if (!block.code.empty() && block.code.back().op == Opcode::Goto) {
+                block.succs.push_back(labelBlock[block.code.back().a.id()]);
+            } else if (block.fallsThrough() && next != noBlock) {
+                block.succs.push_back(next);
+            }
+        }
+        for (uint32_t succ : block.succs) blocks[succ].preds.push_back(b);
+        cfg.layout.push_back(b);
+    }
+    computeDominators(cfg);
+}
+
+void computeDominators(ControlFlowGraph& cfg) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    for (BasicBlock& block : blocks) {
+        block.idom = noBlock;
+        block.children.clear();
+    }
+
+    // Postorder by an explicit depth-first search
+    vector<uint32_t> order;
+    vector<uint32_t> rpoIndex(blocks.size(), noBlock);
+    vector<pair<uint32_t, uint32_t>> stack = {{0, 0}};
+    vector<bool> seen(blocks.size());
+    seen[0] = true;
+    while (!stack.empty()) {
+        auto& [block, nextSucc] = stack.back();
+        if (nextSucc < blocks[block].succs.size()) {
+            uint32_t succ = blocks[block].succs[nextSucc++];
+            if (!seen[succ]) {
+                seen[succ] = true;
+                stack.push_back({succ, 0});
+            }
+            continue;
+        }
+        order.push_back(block);
+        stack.pop_back();
+    }
+    cfg.rpo.assign(order.rbegin(), order.rend());
+    for (uint32_t i = 0; i < cfg.rpo.size(); ++i) rpoIndex[cfg.rpo[i]] = i;
+
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (rpoIndex[a] > rpoIndex[b]) a = blocks[a].idom;
+            while (rpoIndex[b] > rpoIndex[a]) b = blocks[b].idom;
+        }
+        return a;
+    };
+    blocks[0].idom = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t i = 1; i < cfg.rpo.size(); ++i) {
+            BasicBlock& block = blocks[cfg.rpo[i]];
+            uint32_t idom = noBlock;
+            for (uint32_t pred : block.preds) {
+                if (blocks[pred].idom == noBlock) continue;
+                idom = idom == noBlock ? pred : intersect(pred, idom);
+            }
+            if (block.idom != idom) {
+                block.idom = idom;
+                changed = true;
+            }
+        }
+    }
+    for (uint32_t i = 1; i < cfg.rpo.size(); ++i) {
+        uint32_t block = cfg.rpo[i];
+        blocks[blocks[block].idom].children.push_back(block);
+    }
+
+    // Number the dominator tree so that dominance is an interval test
+    uint32_t clock = 0;
+    stack = {{0, 0}};
+    blocks[0].domEnter = clock++;
+    while (!stack.empty()) {
+        auto& [block, nextChild] = stack.back();
+        if (nextChild < blocks[block].children.size()) {
+            uint32_t child = blocks[block].children[nextChild++];
+            blocks[child].domEnter = clock++;
+            stack.push_back({child, 0});
+            continue;
+        }
+        blocks[block].domExit = clock++;
+        stack.pop_back();
+    }
+}
+
+void dominanceFrontiers(const ControlFlowGraph& cfg, vector<vector<uint32_t>>& frontiers) {
+    const vector<BasicBlock>& blocks = cfg.blocks;
+    frontiers.assign(blocks.size(), {});
+    for (uint32_t b : cfg.rpo) {
+        const BasicBlock& block = blocks[b];
+        if (block.preds.size() < 2) continue;
+        for (uint32_t pred : block.preds) {
+            if (!cfg.reachable(pred)) continue;
+            for (uint32_t runner = pred; runner != block.idom; runner = blocks[runner].idom) {
+                if (!frontiers[runner].empty() && frontiers[runner].back() == b) break;
+                frontiers[runner].push_back(b);
+            }
+        }
+    }
+}
+
+uint32_t splitEdge(IRFunction& function, ControlFlowGraph& cfg, uint32_t from, uint32_t to) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    uint32_t middle = blocks.size();
+    blocks.emplace_back();
+
+    BasicBlock& source = blocks[from];
+    size_t slot = find(source.succs.begin(), source.succs.end(), to) - source.succs.begin();
+    source.succs[slot] = middle;
+    if (slot == 0 && source.fallsThrough()) {
+        // Fall-through edge: the new block goes right after its source
+        cfg.layout.insert(find(cfg.layout.begin(), cfg.layout.end(), from) + 1, middle);
+    } else {
+        blocks[middle].label = function.newLabel();
+        jumpTarget(source.code.back()) = blocks[middle].label;
+        cfg.layout.push_back(middle);
+    }
+    BasicBlock& target = blocks[to];
+    *find(target.preds.begin(), target.preds.end(), from) = middle;
+    blocks[middle].preds = {from};
+    blocks[middle].succs = {to};
+
+    if (cfg.reachable(from)) {
+        blocks[middle].idom = from;
+        blocks[from].children.push_back(middle);
+        if (target.preds.size() == 1) {
+            auto& siblings = blocks[target.idom].children;
+            siblings.erase(find(siblings.begin(), siblings.end(), to));
+            target.idom = middle;
+            blocks[middle].children.push_back(to);
+        }
+    }
+    return middle;
+}
+
+void removeEdge(ControlFlowGraph& cfg, uint32_t from, uint32_t to) {
+    vector<uint32_t>& succs = cfg.blocks[from].succs;
+    succs.erase(find(succs.begin(), succs.end(), to));
+    BasicBlock& target = cfg.blocks[to];
+    size_t slot = find(target.preds.begin(), target.preds.end(), from) - target.preds.begin();
+    target.preds.erase(target.preds.begin() + slot);
+    for (Phi& phi : target.phis) phi.args.erase(phi.args.begin() + slot);
+}
+
+size_t removeUnreachableBlocks(ControlFlowGraph& cfg) {
+    computeDominators(cfg);
+    size_t removed = 0;
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        if (cfg.reachable(b)) continue;
+        BasicBlock& block = cfg.blocks[b];
+        while (!block.succs.empty()) removeEdge(cfg, b, block.succs.back());
+        removed += block.code.size();
+        block.code.clear();
+        block.phis.clear();
+    }
+    cfg.layout.erase(remove_if(cfg.layout.begin(), cfg.layout.end(), [&](uint32_t b) { return !cfg.reachable(b); }),
+                     cfg.layout.end());
+    return removed;
+}
+
+void flattenCFG(ControlFlowGraph& cfg, IRFunction& function) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    const vector<uint32_t>& layout = cfg.layout;
+    auto nextInLayout = [&](size_t i) { return i + 1 < layout.size() ? layout[i + 1] : noBlock; };
+    // A goto to the block that follows anyway is dropped
+    for (size_t i = 0; i < layout.size(); ++i) {
+        BasicBlock& block = blocks[layout[i]];
+        if (!block.code.empty() && block.code.back().op == Opcode::Goto && block.succs[0] == nextInLayout(i)) {
+            block.code.pop_back();
+        }
+    }
+    // Only blocks something jumps to keep a label
+    vector<bool> targeted(blocks.size());
+    for (size_t i = 0; i < layout.size(); ++i) {
+        const BasicBlock& block = blocks[layout[i]];
+        if (block.succs.empty()) continue;
+        if (!block.code.empty() && block.code.back().op == Opcode::IfNot) targeted[block.succs[1]] = true;
+        if (!block.fallsThrough() || block.succs[0] != nextInLayout(i)) targeted[block.succs[0]] = true;
+    }
+
+    function.code.clear();
+    for (size_t i = 0; i < layout.size(); ++i) {
+        BasicBlock& block = blocks[layout[i]];
+        if (targeted[layout[i]]) {
+            if (block.label.isNone()) block.label = function.newLabel();
+            function.emit(Opcode::Label, {}, block.label);
+        }
+        function.code.insert(function.code.end(), block.code.begin(), block.code.end());
+        if (block.fallsThrough() && !block.succs.empty() && block.succs[0] != nextInLayout(i)) {
+            function.emit(Opcode::Goto, {}, blocks[block.succs[0]].label);
+        }
+    }
+    function.rebuildLabelTable();
+}
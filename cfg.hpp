@@ -0,0 +1,68 @@
+#ifndef CFG_HPP
+#define CFG_HPP
+
+#include <cstdint>
+#include <vector>
+#include "ir.hpp"
+using namespace std;
+
+const uint32_t noBlock = UINT32_MAX;
+
+// A phi selects one argument per predecessor, in the order of
+// BasicBlock::preds
+struct Phi {
+    Operand dst;
+    vector<Operand> args;
+};
+
+// Straight-line code with a single entry at the top. Label quads are not
+// kept in the code; a jump (IfNot, Goto or Return), if any, is the last
+// quad. succs[0] is the fall-through successor unless the block ends in a
+// Goto or Return, and the jump target of an IfNot is succs[1].
+struct BasicBlock {
+    Operand label;
+    vector<Phi> phis;
+    vector<Quad> code;
+    vector<uint32_t> preds;
+    vector<uint32_t> succs;
+    uint32_t idom = noBlock;   // immediate dominator, noBlock if unreachable
+    vector<uint32_t> children; // dominator tree
+    uint32_t domEnter = 0;     // dominator tree DFS interval, see dominates()
+    uint32_t domExit = 0;
+
+    bool fallsThrough() const;
+};
+
+struct ControlFlowGraph {
+    vector<BasicBlock> blocks; // blocks[0] is the entry
+    vector<uint32_t> layout;   // order in which blocks are emitted
+    vector<uint32_t> rpo;      // reachable blocks in reverse postorder
+
+    bool reachable(uint32_t block) const { return blocks[block].idom != noBlock; }
+    bool dominates(uint32_t a, uint32_t b) const;
+};
+
+// Splits function.code into basic blocks, leaving it empty, and computes
+// dominators
+void buildCFG(IRFunction& function, ControlFlowGraph& cfg);
+// Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder
+void computeDominators(ControlFlowGraph& cfg);
+// frontiers[b] lists the blocks where b's dominance ends
+void dominanceFrontiers(const ControlFlowGraph& cfg, vector<vector<uint32_t>>& frontiers);
+// Inserts an empty block on the edge from -> to and returns it. Immediate
+// dominators stay correct; rpo and dominates() are stale until
+// computeDominators() runs again.
+uint32_t splitEdge(IRFunction& function, ControlFlowGraph& cfg, uint32_t from, uint32_t to);
+// Removes the edge from the successor list of one block and the
+// predecessor list (and phi arguments) of the other. The caller keeps the
+// final jump of the source block consistent.
+void removeEdge(ControlFlowGraph& cfg, uint32_t from, uint32_t to);
+// Recomputes dominators and empties every block that can no longer be
+// reached, dropping it from the layout. Returns the number of quads removed.
+size_t removeUnreachableBlocks(ControlFlowGraph& cfg);
+// Writes the blocks back to function.code in layout order, adding labels
+// and gotos where a fall-through no longer reaches the next block. Gotos to
+// the next block and labels nothing jumps to are dropped.
+void flattenCFG(ControlFlowGraph& cfg, IRFunction& function);
+
+#endif // CFG_HPP
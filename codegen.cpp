@@ -1,39 +1,777 @@
 #include "codegen.hpp"
+#include "frame.hpp"
+#include "peephole.hpp"
+#include "regalloc.hpp"
 #include <iostream>
 
-void generateIntermediateCode(ASTNode* ast, vector<string>& code) {
-    int tempCount = 0;
-    if (ast) ast->generateIntermediateCode(code, tempCount);
+void generateIntermediateCode(ASTNode* ast, IRModule& module) {
+    if (ast) ast->generateIntermediateCode(module);
 }
 
-void generateAssembly(ASTNode* ast, vector<string>& asmCode) {
-    int regCount = 0;
-    vector<pair<string, string>> stringLiterals;
-    vector<string> instructions;
-    
-    if (ast) ast->generateAssembly(instructions, stringLiterals, regCount, "");
-    
-    // 1. Data Section
+static Cond condFor(Opcode op) {
+    switch (op) {
+        case Opcode::CmpEq: return Cond::E;
+        case Opcode::CmpNe: return Cond::NE;
+        case Opcode::CmpLt: return Cond::L;
+        case Opcode::CmpLe: return Cond::LE;
+        case Opcode::CmpGt: return Cond::G;
+        default: return Cond::GE;
+    }
+}
+
+static uint32_t magnitude(int32_t value) {
+    return value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+}
+
+static uint8_t log2Exact(uint32_t power) {
+    uint8_t k = 0;
+    while (power >>= 1) k++;
+    return k;
+}
+
+// One step of a multiplication by a constant: shl by amount, or lea
+// [x+x*(amount-1)] for amount 3, 5 or 9. Either takes a cycle; imul takes
+// three.
+struct ScaleStep {
+    bool shift;
+    uint8_t amount;
+};
+
+// Splits factor into at most two steps; 0 if it takes more
+static uint32_t scaleSteps(uint32_t factor, ScaleStep steps[2]) {
+    if ((factor & (factor - 1)) == 0) {
+        steps[0] = {true, log2Exact(factor)};
+        return 1;
+    }
+    for (uint32_t f : {9u, 5u, 3u}) {
+        if (factor % f != 0) continue;
+        uint32_t rest = factor / f;
+        steps[0] = {false, static_cast<uint8_t>(f)};
+        if (rest == 1) return 1;
+        if ((rest & (rest - 1)) == 0) {
+            steps[1] = {true, log2Exact(rest)};
+            return 2;
+        }
+        if (rest == 3 || rest == 5 || rest == 9) {
+            steps[1] = {false, static_cast<uint8_t>(rest)};
+            return 2;
+        }
+    }
+    return 0;
+}
+
+// Signed division by a constant d, |d| >= 2 and not a power of two, as a
+// multiply by a fixed-point reciprocal (Hacker's Delight 10-1): the
+// quotient is the high half of a * multiplier, adjusted by a when the
+// multiplier's sign differs from d's, shifted right by shift and rounded
+// toward zero by adding its sign bit.
+struct Reciprocal {
+    int32_t multiplier;
+    uint8_t shift;
+};
+
+static Reciprocal reciprocal(int32_t d) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = magnitude(d);
+    uint32_t t = two31 + (static_cast<uint32_t>(d) >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    uint32_t p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) q1++, r1 -= anc;
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) q2++, r2 -= ad;
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    uint32_t multiplier = q2 + 1;
+    if (d < 0) multiplier = 0u - multiplier;
+    return {static_cast<int32_t>(multiplier), static_cast<uint8_t>(p - 32)};
+}
+
+// A quad together with the quads folded into it
+struct Tile {
+    // An Add computed by one lea: dst = base + index*scale + disp
+    bool address = false;
+    Operand base;
+    Operand index;
+    uint8_t scale = 1;
+    int32_t disp = 0;
+    // An IfNot branching on the flags of this compare quad
+    uint32_t compare = UINT32_MAX;
+};
+
+// Folds stay short so they stretch no live range far
+static const uint32_t maxFoldDistance = 16;
+
+// Chooses the tiles that cover more than one quad, and for each quad the
+// quad whose instructions read its operands (see allocateRegisters()).
+// Params are covered by their Call. An Add absorbs a single-use temporary
+// it reads, defined shortly before in the same block, when together they
+// still form an x86 address: scaling by 2, 4 or 8 (3, 5 or 9 as x + x*k),
+// adding a constant, or adding a second value. An IfNot absorbs the
+// compare it tests the same way, to branch on cmp with no 0/1 value.
+static void tileFunction(const IRFunction& function, vector<uint32_t>& readAt, vector<Tile>& tiles) {
+    const vector<Quad>& code = function.code;
+    uint32_t n = code.size();
+    readAt.resize(n);
+    tiles.assign(n, {});
+    vector<uint32_t> block(n), definition(function.tempCount, UINT32_MAX), uses(function.tempCount);
+    vector<uint32_t> params;
+    uint32_t current = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const Quad& quad = code[i];
+        readAt[i] = i;
+        if (quad.op == Opcode::Label) current++;
+        block[i] = current;
+        if (quad.op == Opcode::IfNot || quad.op == Opcode::Goto || quad.op == Opcode::Return) current++;
+        if (quad.op == Opcode::Param) params.push_back(i);
+        if (quad.op == Opcode::Call) {
+            for (uint32_t param : params) readAt[param] = i;
+            params.clear();
+        }
+        if (quad.dst.kind == OperandKind::Temp) definition[quad.dst.id()] = i;
+        for (Operand operand : {quad.a, quad.b}) {
+            if (operand.kind == OperandKind::Temp) uses[operand.id()]++;
+        }
+    }
+
+    struct Terms {
+        Operand values[2];
+        uint8_t scales[2] = {1, 1};
+        uint32_t count = 0;
+        uint32_t disp = 0; // wraps like the arithmetic it replaces
+        bool add(Operand value, uint8_t scale) {
+            if (value.kind != OperandKind::Var && value.kind != OperandKind::Temp) return false;
+            if (count == 2 || (scale != 1 && count == 1 && scales[0] != 1)) return false;
+            values[count] = value;
+            scales[count++] = scale;
+            return true;
+        }
+        bool addConstant(Operand operand) {
+            if (operand.kind != OperandKind::Const) return false;
+            disp += static_cast<uint32_t>(operand.value);
+            return true;
+        }
+    };
+    // Adds the computation of the quad at d to terms
+    auto expand = [&](uint32_t d, Terms& terms) {
+        const Quad& quad = code[d];
+        switch (quad.op) {
+        case Opcode::Mul: {
+            Operand value = quad.a, factor = quad.b;
+            if (value.kind == OperandKind::Const) swap(value, factor);
+            if (factor.kind != OperandKind::Const) return false;
+            switch (factor.value) {
+                case 2: case 4: case 8: return terms.add(value, factor.value);
+                case 3: case 5: case 9: return terms.add(value, 1) && terms.add(value, factor.value - 1);
+                default: return false;
+            }
+        }
+        case Opcode::Add:
+            return (terms.addConstant(quad.a) || terms.add(quad.a, 1)) &&
+                   (terms.addConstant(quad.b) || terms.add(quad.b, 1));
+        case Opcode::Sub:
+            if (quad.b.kind != OperandKind::Const || !terms.add(quad.a, 1)) return false;
+            terms.disp -= static_cast<uint32_t>(quad.b.value);
+            return true;
+        default:
+            return false;
+        }
+    };
+    // Whether the quad defining temp can be folded into the quad at j
+    auto foldable = [&](Operand temp, uint32_t j) {
+        if (temp.kind != OperandKind::Temp || uses[temp.id()] != 1) return false;
+        uint32_t d = definition[temp.id()];
+        if (d == UINT32_MAX || d >= j || block[d] != block[j] || j - d > maxFoldDistance) return false;
+        if (readAt[d] != d || tiles[d].address) return false;
+        // Its operands are read at j instead, so they must still hold
+        for (uint32_t k = d + 1; k < j; ++k) {
+            Operand written = code[k].dst;
+            if (written.kind == OperandKind::Var && (written == code[d].a || written == code[d].b)) return false;
+        }
+        return true;
+    };
+
+    for (uint32_t j = 0; j < n; ++j) {
+        const Quad& quad = code[j];
+        if (quad.op == Opcode::IfNot && foldable(quad.a, j) && isCompare(code[definition[quad.a.id()]].op)) {
+            tiles[j].compare = definition[quad.a.id()];
+            readAt[tiles[j].compare] = j;
+            continue;
+        }
+        if (quad.op != Opcode::Add || quad.dst.isNone()) continue;
+        Terms terms;
+        uint32_t folds[2];
+        uint32_t foldCount = 0;
+        for (Operand operand : {quad.a, quad.b}) {
+            Terms trial = terms;
+            if (foldable(operand, j) && expand(definition[operand.id()], trial)) {
+                terms = trial;
+                folds[foldCount++] = definition[operand.id()];
+            } else if (!terms.addConstant(operand) && !terms.add(operand, 1)) {
+                foldCount = 0;
+                break;
+            }
+        }
+        if (foldCount == 0) continue;
+        Tile& tile = tiles[j];
+        tile.address = true;
+        tile.disp = static_cast<int32_t>(terms.disp);
+        // The scaled value, if any, is the index
+        uint32_t scaled = terms.scales[0] != 1 ? 0 : 1;
+        if (terms.count == 1) {
+            if (terms.scales[0] == 1) tile.base = terms.values[0];
+            else if (terms.scales[0] == 2) tile.base = tile.index = terms.values[0]; // x + x needs no disp32
+            else tile.index = terms.values[0], tile.scale = terms.scales[0];
+        } else {
+            tile.base = terms.values[1 - scaled];
+            tile.index = terms.values[scaled];
+            tile.scale = terms.scales[scaled];
+        }
+        for (uint32_t f = 0; f < foldCount; ++f) readAt[folds[f]] = j;
+    }
+}
+
+// Branch layout over the finished code, to a fixpoint: a jump to a jmp
+// goes straight to that jmp's target, and a jcc over a jmp becomes the
+// opposite jcc to the jmp's target. Jumps to the next instruction, code
+// after a jmp up to the next label and labels no jump names are dropped.
+// Then blocks keep falling through, as static prediction expects of a
+// forward branch.
+static void layoutBranches(MFunction& function) {
+    vector<MInstr>& code = function.code;
+    uint32_t labelCount = function.exitLabel + 1;
+    vector<uint32_t> position(labelCount), references(labelCount);
+    auto isJump = [](const MInstr& instr) { return instr.op == MOp::Jmp || instr.op == MOp::Jcc; };
+    // Per sweep: the first instruction at or after each index that is not
+    // a label, and where a jump to each label lands past any chain of
+    // jmps, so that both questions below take constant time
+    vector<uint32_t> nonLabel;
+    vector<int32_t> landing(labelCount);
+    vector<uint8_t> state(labelCount); // 0 unresolved, 1 on the chain being followed, 2 resolved
+    vector<int32_t> chain;
+    auto resolve = [&](int32_t label) {
+        chain.clear();
+        int32_t at = label;
+        for (;;) {
+            if (state[at] == 2) break;
+            if (state[at] == 1) {
+                // A cycle of jmps: every label on it stays where it is
+                for (int32_t member : chain) {
+                    state[member] = 2;
+                    landing[member] = member;
+                }
+                return landing[label];
+            }
+            state[at] = 1;
+            chain.push_back(at);
+            uint32_t p = nonLabel[position[at]];
+            if (p == code.size() || code[p].op != MOp::Jmp) {
+                state[at] = 2;
+                landing[at] = at;
+                chain.pop_back();
+                break;
+            }
+            at = code[p].dst.value;
+        }
+        for (int32_t member : chain) {
+            state[member] = 2;
+            landing[member] = landing[at];
+        }
+        return landing[label];
+    };
+    // Whether only labels lie between the instruction at i and label
+    auto follows = [&](uint32_t i, int32_t label) {
+        return position[label] > i && nonLabel[i + 1] >= position[label];
+    };
+
+    vector<MInstr> laidOut;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            if (code[i].op == MOp::Label) position[code[i].dst.value] = i;
+        }
+        nonLabel.resize(code.size() + 1);
+        nonLabel[code.size()] = code.size();
+        for (uint32_t i = code.size(); i-- > 0;) nonLabel[i] = code[i].op == MOp::Label ? nonLabel[i + 1] : i;
+        fill(state.begin(), state.end(), 0);
+        fill(references.begin(), references.end(), 0);
+        for (MInstr& instr : code) {
+            if (!isJump(instr)) continue;
+            int32_t lands = resolve(instr.dst.value);
+            changed = changed || lands != instr.dst.value;
+            instr.dst.value = lands;
+            references[lands]++;
+        }
+        laidOut.clear();
+        bool reachable = true;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            const MInstr& instr = code[i];
+            bool keep = true;
+            if (instr.op == MOp::Label) {
+                keep = references[instr.dst.value] > 0;
+                reachable = reachable || keep;
+            } else if (!reachable) {
+                keep = false;
+            } else if (isJump(instr) && follows(i, instr.dst.value)) {
+                keep = false;
+            } else if (instr.op == MOp::Jcc && i + 1 < code.size() && code[i + 1].op == MOp::Jmp &&
+                       follows(i + 1, instr.dst.value)) {
+                laidOut.push_back({MOp::Jcc, ::negate(instr.cond), code[i + 1].dst, {}, {}});
+                changed = true;
+                i++;
+                continue;
+            }
+            changed = changed || !keep;
+            if (!keep) continue;
+            laidOut.push_back(instr);
+            if (instr.op == MOp::Jmp || instr.op == MOp::Ret) reachable = false;
+        }
+        code.swap(laidOut);
+    }
+}
+
+static void generateFunction(const IRFunction& function, Target target, MFunction& out) {
+    const CallingConvention& convention = callingConvention(target);
+    vector<uint32_t> readAt;
+    vector<Tile> tiles;
+    tileFunction(function, readAt, tiles);
+    RegisterAllocation allocation;
+    allocateRegisters(function, convention, readAt, allocation);
+    out.name = function.name;
+    out.target = target;
+    out.exitLabel = function.labels.size();
+    vector<MInstr>& code = out.code;
+
+    bool makesCalls = false;
+    for (const Quad& quad : function.code) makesCalls = makesCalls || quad.op == Opcode::Call;
+    FrameLayout frame;
+    layoutFrame(allocation, convention, makesCalls, frame);
+
+    // Temporaries and variables live in registers or frame slots
+    auto location = [&](Operand operand) -> MOperand {
+        switch (operand.kind) {
+        case OperandKind::Temp:
+        case OperandKind::Var: {
+            uint32_t value = allocation.index(operand);
+            if (allocation.registers[value] != Reg::None) return MOperand::reg(allocation.registers[value]);
+            if (allocation.slots[value] == noSlot) return {}; // never read
+            return frame.slot(allocation.slots[value]);
+        }
+        case OperandKind::Const: return MOperand::imm(operand.value);
+        case OperandKind::String: return MOperand::string(operand.id());
+        case OperandKind::Label: return MOperand::label(operand.id());
+        default: return {};
+        }
+    };
+    auto emit = [&](MOp op, MOperand dst = {}, MOperand src = {}) { code.push_back({op, Cond::E, dst, src, {}}); };
+    auto emitCond = [&](MOp op, Cond cond, MOperand dst) { code.push_back({op, cond, dst, {}, {}}); };
+    const MOperand eax = MOperand::reg(Reg::EAX), esp = MOperand::reg(Reg::ESP), ebp = MOperand::reg(Reg::EBP);
+    // x86 has no memory-to-memory mov; such copies go through eax
+    auto move = [&](MOperand dst, MOperand src) {
+        if (dst.isNone() || dst == src) return;
+        if (dst.isMem() && src.isMem()) {
+            emit(MOp::Mov, eax, src);
+            src = eax;
+        }
+        emit(MOp::Mov, dst, src);
+    };
+    // dst = base + index*scale + disp, by lea where possible; base or
+    // index may be absent. Operands in memory go through eax.
+    auto address = [&](MOperand dst, MOperand base, MOperand index, uint8_t scale, int32_t disp) {
+        if (dst.isNone()) return;
+        MOperand addend; // added after the lea when eax cannot hold both
+        if (base.isMem() && index.isMem()) {
+            addend = base;
+            base = {};
+        } else if (base.isMem()) {
+            emit(MOp::Mov, eax, base);
+            base = eax;
+        }
+        if (index.isMem()) {
+            emit(MOp::Mov, eax, index);
+            index = eax;
+        }
+        if (base.isNone() && scale == 1) swap(base, index);
+        MOperand target = dst.isReg() && addend.isNone() ? dst : eax;
+        MOperand memory = MOperand::mem(base.isNone() ? Reg::None : base.base, disp);
+        if (!index.isNone()) {
+            memory.index = index.base;
+            memory.scale = scale;
+        }
+        if (memory.index == Reg::None && disp == 0) move(target, base);
+        else emit(MOp::Lea, target, memory);
+        if (!addend.isNone()) emit(MOp::Add, target, addend);
+        move(dst, target);
+    };
+    // cmp for a compare quad; returns the condition under which it holds
+    auto compare = [&](const Quad& quad) {
+        MOperand a = location(quad.a), b = location(quad.b);
+        Cond cond = condFor(quad.op);
+        if (a.isConstant() && !b.isConstant()) {
+            swap(a, b);
+            cond = swapOperands(cond);
+        }
+        if (a.isConstant() || (a.isMem() && b.isMem())) {
+            emit(MOp::Mov, eax, a);
+            a = eax;
+        }
+        emit(MOp::Cmp, a, b);
+        return cond;
+    };
+    // Register arguments, a parallel move: a register is written only
+    // once no pending move still reads it, and a cycle is broken by
+    // saving one register in eax. Strings are addresses, loaded by lea.
+    auto loadArguments = [&](vector<pair<Reg, MOperand>>& moves) {
+        while (!moves.empty()) {
+            size_t ready = moves.size();
+            for (size_t m = 0; m < moves.size() && ready == moves.size(); ++m) {
+                bool read = false;
+                for (const auto& other : moves) read = read || other.second.isReg(moves[m].first);
+                if (!read) ready = m;
+            }
+            if (ready == moves.size()) {
+                MOperand saved = MOperand::reg(moves[0].first);
+                emit(MOp::Mov, eax, saved);
+                for (auto& other : moves) {
+                    if (other.second == saved) other.second = eax;
+                }
+                continue;
+            }
+            MOperand dst = MOperand::reg(moves[ready].first), src = moves[ready].second;
+            if (src.kind == MKind::String) emit(MOp::Lea, dst, src);
+            else move(dst, src);
+            moves.erase(moves.begin() + ready);
+        }
+    };
+    vector<MOperand> params; // arguments of the next call, in source order
+
+    // Prologue
+    emit(MOp::Push, ebp);
+    emit(MOp::Mov, ebp, esp);
+    for (Reg reg : frame.saved) emit(MOp::Push, MOperand::reg(reg));
+    if (frame.reserved > 0) emit(MOp::Sub, esp, MOperand::imm(frame.reserved));
+
+    for (uint32_t i = 0; i < function.code.size(); ++i) {
+        const Quad& quad = function.code[i];
+        // Folded quads are emitted as part of a later instruction
+        if (readAt[i] != i && quad.op != Opcode::Param) continue;
+        MOperand dst = location(quad.dst), a = location(quad.a), b = location(quad.b);
+        switch (quad.op) {
+        case Opcode::Copy:
+            move(dst, a);
+            break;
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul: {
+            if (dst.isNone()) break;
+            MOp op = quad.op == Opcode::Add ? MOp::Add : quad.op == Opcode::Sub ? MOp::Sub : MOp::Imul;
+            if (tiles[i].address) {
+                const Tile& tile = tiles[i];
+                address(dst, location(tile.base), location(tile.index), tile.scale, tile.disp);
+                break;
+            }
+            if (quad.op == Opcode::Add && a.kind == MKind::Imm) swap(a, b);
+            if (dst.isReg() && a.isReg() && dst != a) {
+                // lea writes a third register, saving the copy
+                if (quad.op == Opcode::Add && b.isReg() && dst != b) {
+                    address(dst, a, b, 1, 0);
+                    break;
+                }
+                if (quad.op != Opcode::Mul && b.kind == MKind::Imm) {
+                    uint32_t offset = static_cast<uint32_t>(b.value);
+                    address(dst, a, {}, 1, static_cast<int32_t>(quad.op == Opcode::Add ? offset : 0u - offset));
+                    break;
+                }
+            }
+            if (quad.op == Opcode::Mul && (a.kind == MKind::Imm) != (b.kind == MKind::Imm)) {
+                if (a.kind == MKind::Imm) swap(a, b);
+                if (b.value == 0) {
+                    emit(MOp::Mov, dst, b);
+                    break;
+                }
+                MOperand target = dst.isReg() ? dst : eax;
+                ScaleStep steps[2];
+                uint32_t stepCount = scaleSteps(magnitude(b.value), steps);
+                bool negative = b.value < 0;
+                if (stepCount > 0 && stepCount + negative <= 2) {
+                    // Shifts and lea, then neg for a negative factor
+                    MOperand value = a;
+                    for (uint32_t s = 0; s < stepCount; ++s) {
+                        if (steps[s].shift) {
+                            if (steps[s].amount == 0) continue;
+                            move(target, value);
+                            value = target;
+                            emit(MOp::Shl, target, MOperand::imm(steps[s].amount));
+                            continue;
+                        }
+                        if (!value.isReg()) {
+                            emit(MOp::Mov, eax, value);
+                            value = eax;
+                        }
+                        MOperand memory = MOperand::mem(value.base, 0);
+                        memory.index = value.base;
+                        memory.scale = steps[s].amount - 1;
+                        emit(MOp::Lea, target, memory);
+                        value = target;
+                    }
+                    move(target, value);
+                    if (negative) emit(MOp::Neg, target);
+                    move(dst, target);
+                    break;
+                }
+                // Three-operand imul: dst = a * imm, a in a register or memory
+                code.push_back({MOp::Imul, Cond::E, target, a, b});
+                move(dst, target);
+                break;
+            }
+            if (dst.isReg() && dst == b && dst != a) {
+                // The result register holds the right operand
+                if (op == MOp::Sub) {
+                    emit(MOp::Neg, dst);
+                    emit(MOp::Add, dst, a);
+                } else {
+                    emit(op, dst, a);
+                }
+                break;
+            }
+            // Two-address form; imul cannot write memory
+            MOperand target = dst.isReg() ? dst : eax;
+            move(target, a);
+            emit(op, target, b);
+            move(dst, target);
+            break;
+        }
+        case Opcode::Div:
+        case Opcode::Mod: {
+            // Only a division by zero can trap
+            if (dst.isNone() && b.kind == MKind::Imm && b.value != 0) break;
+            int32_t folded;
+            if (a.kind == MKind::Imm && b.kind == MKind::Imm && evaluateBinary(quad.op, a.value, b.value, folded)) {
+                emit(MOp::Mov, dst, MOperand::imm(folded));
+                break;
+            }
+            if (b.kind == MKind::Imm && magnitude(b.value) == 1) {
+                // x / 1 is x, x / -1 is -x and x % 1 is 0
+                if (quad.op == Opcode::Mod) {
+                    emit(MOp::Mov, dst, MOperand::imm(0));
+                } else if (b.value == 1) {
+                    move(dst, a);
+                } else {
+                    MOperand target = dst.isReg() ? dst : eax;
+                    move(target, a);
+                    emit(MOp::Neg, target);
+                    move(dst, target);
+                }
+                break;
+            }
+            if (dividesByShifting(quad.b)) {
+                // sar rounds toward minus infinity; adding 2^k - 1 to a
+                // negative dividend first rounds toward zero
+                uint8_t k = log2Exact(magnitude(b.value));
+                MOperand target = dst.isReg() && dst != a ? dst : eax;
+                move(target, a);
+                if (k > 1) emit(MOp::Sar, target, MOperand::imm(31));
+                emit(MOp::Shr, target, MOperand::imm(32 - k));
+                emit(MOp::Add, target, a);
+                if (quad.op == Opcode::Div) {
+                    emit(MOp::Sar, target, MOperand::imm(k));
+                    if (b.value < 0) emit(MOp::Neg, target);
+                } else {
+                    // a - (a rounded toward zero to a multiple of 2^k)
+                    emit(MOp::And, target, MOperand::imm(static_cast<int32_t>(0u - (1u << k))));
+                    emit(MOp::Neg, target);
+                    emit(MOp::Add, target, a);
+                }
+                move(dst, target);
+                break;
+            }
+            const MOperand edx = MOperand::reg(Reg::EDX);
+            if (b.kind == MKind::Imm && b.value != 0) {
+                // The quotient is computed in edx, where a is not (see
+                // dividesByShifting()); a is not constant, or it folded
+                Reciprocal r = reciprocal(b.value);
+                emit(MOp::Mov, eax, MOperand::imm(r.multiplier));
+                emit(MOp::Imul, a);
+                if (b.value > 0 && r.multiplier < 0) emit(MOp::Add, edx, a);
+                if (b.value < 0 && r.multiplier > 0) emit(MOp::Sub, edx, a);
+                if (r.shift > 0) emit(MOp::Sar, edx, MOperand::imm(r.shift));
+                emit(MOp::Mov, eax, edx);
+                emit(MOp::Shr, eax, MOperand::imm(31));
+                emit(MOp::Add, edx, eax);
+                if (quad.op == Opcode::Mod) {
+                    // a - quotient * b
+                    code.push_back({MOp::Imul, Cond::E, edx, edx, b});
+                    emit(MOp::Neg, edx);
+                    emit(MOp::Add, edx, a);
+                }
+                move(dst, edx);
+                break;
+            }
+            move(eax, a);
+            emit(MOp::Cdq);
+            if (b.isConstant()) {
+                // Division by zero: idiv takes no immediate, and eax and
+                // edx are both busy
+                emit(MOp::Push, b);
+                emit(MOp::Idiv, MOperand::mem(Reg::ESP, 0));
+                emit(MOp::Add, esp, MOperand::imm(convention.wordSize));
+            } else {
+                emit(MOp::Idiv, b);
+            }
+            move(dst, quad.op == Opcode::Div ? eax : edx);
+            break;
+        }
+        case Opcode::CmpEq:
+        case Opcode::CmpNe:
+        case Opcode::CmpLt:
+        case Opcode::CmpLe:
+        case Opcode::CmpGt:
+        case Opcode::CmpGe: {
+            // Materialized only as a value; branches test the flags
+            if (dst.isNone()) break;
+            emitCond(MOp::Setcc, compare(quad), eax);
+            if (dst.isReg()) {
+                emit(MOp::Movzx, dst, eax);
+            } else {
+                emit(MOp::Movzx, eax, eax);
+                emit(MOp::Mov, dst, eax);
+            }
+            break;
+        }
+        case Opcode::Param:
+            params.push_back(a);
+            break;
+        case Opcode::Call: {
+            // The leading arguments go in registers, the rest are pushed
+            // in reverse order
+            size_t inRegisters = min(params.size(), convention.argumentRegisters.size());
+            size_t pushedCount = params.size() - inRegisters;
+            uint32_t padding = frame.callPadding(pushedCount);
+            if (padding > 0) emit(MOp::Sub, esp, MOperand::imm(padding));
+            for (size_t k = params.size(); k-- > inRegisters;) {
+                MOperand argument = params[k];
+                if (target == Target::X64 && argument.kind == MKind::String) {
+                    emit(MOp::Lea, eax, argument);
+                    argument = eax;
+                }
+                emit(MOp::Push, argument);
+            }
+            vector<pair<Reg, MOperand>> moves;
+            for (size_t k = 0; k < inRegisters; ++k) moves.push_back({convention.argumentRegisters[k], params[k]});
+            loadArguments(moves);
+            // The callee may be variadic like printf: al holds the number
+            // of vector registers used
+            if (target == Target::X64) emit(MOp::Xor, eax, eax);
+            emit(MOp::Call, MOperand::symbol(quad.a.id()));
+            uint32_t pushed = convention.wordSize * pushedCount + padding;
+            if (pushed > 0) emit(MOp::Add, esp, MOperand::imm(pushed));
+            move(dst, eax);
+            params.clear();
+            break;
+        }
+        case Opcode::Return:
+            if (!a.isNone()) move(eax, a);
+            // Jump to shared epilogue
+            emit(MOp::Jmp, MOperand::label(out.exitLabel));
+            break;
+        case Opcode::IfNot:
+            if (tiles[i].compare != UINT32_MAX) {
+                // cmp and the opposite jcc; no 0/1 value
+                const Quad& test = function.code[tiles[i].compare];
+                int32_t holds;
+                if (test.a.kind == OperandKind::Const && test.b.kind == OperandKind::Const &&
+                    evaluateBinary(test.op, test.a.value, test.b.value, holds)) {
+                    if (!holds) emit(MOp::Jmp, b);
+                    break;
+                }
+                emitCond(MOp::Jcc, ::negate(compare(test)), b);
+                break;
+            }
+            if (a.isConstant()) {
+                if (a.kind == MKind::Imm && a.value == 0) emit(MOp::Jmp, b);
+                break;
+            }
+            if (a.isReg()) emit(MOp::Test, a, a);
+            else emit(MOp::Cmp, a, MOperand::imm(0));
+            emitCond(MOp::Jcc, Cond::E, b);
+            break;
+        case Opcode::Goto:
+            emit(MOp::Jmp, a);
+            break;
+        case Opcode::Label:
+            emit(MOp::Label, a);
+            break;
+        }
+    }
+
+    // Epilogue (in case no return stmt) acts as target for jumps
+    emit(MOp::Label, MOperand::label(out.exitLabel));
+    if (frame.saved.empty()) {
+        emit(MOp::Mov, esp, ebp);
+    } else {
+        emit(MOp::Lea, esp, MOperand::mem(Reg::EBP, -static_cast<int32_t>(frame.wordSize * frame.saved.size())));
+        for (auto it = frame.saved.rbegin(); it != frame.saved.rend(); ++it) emit(MOp::Pop, MOperand::reg(*it));
+    }
+    emit(MOp::Pop, ebp);
+    emit(MOp::Ret);
+    layoutBranches(out);
+}
+
+void generateMachineCode(const IRModule& module, Target target, vector<MFunction>& functions) {
+    functions.resize(module.functions.size());
+    for (size_t i = 0; i < module.functions.size(); ++i) generateFunction(module.functions[i], target, functions[i]);
+}
+
+void formatAssembly(const IRModule& module, const vector<MFunction>& functions, vector<string>& asmCode) {
+    // 1. Data Section, with only the literals the code still refers to
+    vector<bool> used(module.strings.size());
+    for (const MFunction& function : functions) {
+        for (const MInstr& instr : function.code) {
+            for (const MOperand& operand : {instr.dst, instr.src}) {
+                if (operand.kind == MKind::String) used[operand.value] = true;
+            }
+        }
+    }
     asmCode.push_back("section .data");
-    for (const auto& sl : stringLiterals) {
+    for (size_t i = 0; i < module.strings.size(); ++i) {
+        if (!used[i]) continue;
         // Handle escape characters if necessary, but simple for now
-        asmCode.push_back("    " + sl.first + " db \"" + sl.second + "\", 0");
+        asmCode.push_back("    LC" + to_string(i) + " db \"" + string(module.strings[i]) + "\", 0");
     }
     asmCode.push_back("");
 
     // 2. Text Section
     asmCode.push_back("section .text");
-    asmCode.push_back("    global _main");
-    asmCode.push_back("    extern _printf");
+    Target target = functions.empty() ? Target::X86 : functions[0].target;
+    for (const MFunction& function : functions) asmCode.push_back("    global " + symbolName(function.name, target));
+    for (string_view symbol : module.symbols) {
+        bool defined = false;
+        for (const MFunction& function : functions) defined = defined || function.name == symbol;
+        if (!defined) asmCode.push_back("    extern " + symbolName(symbol, target));
+    }
     asmCode.push_back("");
-    
-    // 3. Instructions
-    for (const auto& instr : instructions) {
-         // Indent instructions, but labels should be at start
-         if (instr.back() == ':') {
-             asmCode.push_back(instr);
-         } else {
-             asmCode.push_back("    " + instr);
-         }
-    }
-} 
\ No newline at end of file
+
+    // 3. Instructions; labels start the line
+    for (const MFunction& function : functions) {
+        asmCode.push_back(symbolName(function.name, target) + ":");
+        for (const MInstr& instr : function.code) {
+            string line = formatInstr(module, function, instr);
+            asmCode.push_back(instr.op == MOp::Label ? line : "    " + line);
+        }
+    }
+}
+
+void generateAssembly(const IRModule& module, Target target, vector<string>& asmCode) {
+    vector<MFunction> functions;
+    generateMachineCode(module, target, functions);
+    PeepholeReport report;
+    peephole(functions, report);
+    formatAssembly(module, functions, asmCode);
+}
@@ -4,9 +4,15 @@
 #include <vector>
 #include <string>
 #include "parser.hpp"
+#include "ir.hpp"
+#include "x86.hpp"
 using namespace std;
 
-void generateIntermediateCode(ASTNode* ast, vector<string>& code);
-void generateAssembly(ASTNode* ast, vector<string>& asmCode);
+void generateIntermediateCode(ASTNode* ast, IRModule& module);
+// Instruction selection over the registers allocateRegisters() assigns
+void generateMachineCode(const IRModule& module, Target target, vector<MFunction>& functions);
+// NASM source: data section, declarations, then the code
+void formatAssembly(const IRModule& module, const vector<MFunction>& functions, vector<string>& asmCode);
+void generateAssembly(const IRModule& module, Target target, vector<string>& asmCode);
 
-#endif // CODEGEN_HPP 
\ No newline at end of file
+#endif // CODEGEN_HPP
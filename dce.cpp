@@ -0,0 +1,97 @@
+#include "optimizer.hpp"
+#include "ssa.hpp"
+
+size_t eliminateDeadCode(const IRModule& module, IRFunction& function, ControlFlowGraph& cfg, size_t& deadStores) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    SSAValues values;
+    values.build(module, function, cfg);
+
+    // Where each value is defined, as (block, position) with phis first
+    struct Location {
+        uint32_t block = noBlock;
+        uint32_t position = 0;
+    };
+    vector<Location> definition(values.count);
+    vector<vector<bool>> live(blocks.size());
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        const BasicBlock& block = blocks[b];
+        live[b].resize(block.phis.size() + block.code.size());
+        uint32_t position = 0;
+        for (const Phi& phi : block.phis) definition[values.index(phi.dst)] = {b, position++};
+        for (const Quad& quad : block.code) {
+            uint32_t index = values.index(quad.dst);
+            if (index != noValue) definition[index] = {b, position};
+            position++;
+        }
+    }
+
+    // Mark: instructions with an effect are live, and so is whatever
+    // defines a value a live instruction reads
+    vector<Location> work;
+    vector<bool> read(values.count);
+    auto mark = [&](uint32_t b, uint32_t position) {
+        if (live[b][position]) return;
+        live[b][position] = true;
+        work.push_back({b, position});
+    };
+    auto markDefinition = [&](Operand operand) {
+        uint32_t index = values.index(operand);
+        if (index == noValue) return;
+        read[index] = true;
+        if (definition[index].block != noBlock) mark(definition[index].block, definition[index].position);
+    };
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        const BasicBlock& block = blocks[b];
+        for (size_t i = 0; i < block.code.size(); ++i) {
+            switch (block.code[i].op) {
+            case Opcode::Param:
+            case Opcode::Call:
+            case Opcode::Return:
+            case Opcode::IfNot:
+            case Opcode::Goto:
+                mark(b, block.phis.size() + i);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    while (!work.empty()) {
+        Location at = work.back();
+        work.pop_back();
+        const BasicBlock& block = blocks[at.block];
+        if (at.position < block.phis.size()) {
+            for (const Operand& arg : block.phis[at.position].args) markDefinition(arg);
+        } else {
+            const Quad& quad = block.code[at.position - block.phis.size()];
+            markDefinition(quad.a);
+            markDefinition(quad.b);
+        }
+    }
+
+    // Sweep
+    size_t removed = 0;
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        BasicBlock& block = blocks[b];
+        size_t phiCount = block.phis.size(), kept = 0;
+        for (size_t i = 0; i < phiCount; ++i) {
+            if (!live[b][i]) continue;
+            if (kept != i) block.phis[kept] = move(block.phis[i]);
+            kept++;
+        }
+        block.phis.resize(kept);
+        kept = 0;
+        for (size_t i = 0; i < block.code.size(); ++i) {
+            if (live[b][phiCount + i]) {
+                Quad& quad = block.code[kept++] = block.code[i];
+                // A call made only for its effect keeps no result
+                if (quad.op == Opcode::Call && !quad.dst.isNone() && !read[values.index(quad.dst)]) quad.dst = {};
+            } else {
+                removed++;
+                if (block.code[i].dst.kind == OperandKind::Var) deadStores++;
+            }
+        }
+        block.code.resize(kept);
+    }
+    return removed;
+}
@@ -0,0 +1,205 @@
+#include "elf.hpp"
+
+// From the System V ABI and its i386 and x86-64 supplements
+enum : uint32_t {
+    SHT_PROGBITS = 1, SHT_SYMTAB = 2, SHT_STRTAB = 3, SHT_RELA = 4, SHT_REL = 9,
+    SHF_WRITE = 1, SHF_ALLOC = 2, SHF_EXECINSTR = 4, SHF_INFO_LINK = 0x40,
+    STB_LOCAL = 0, STB_GLOBAL = 1, STT_NOTYPE = 0, STT_FUNC = 2, STT_SECTION = 3,
+    R_386_32 = 1, R_386_PC32 = 2,
+    R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4, R_X86_64_32 = 10,
+};
+
+// Section indices, in the order of the section header table
+enum : uint16_t {
+    TextSection = 1, DataSection, SymtabSection, StrtabSection, RelSection, NoteSection, ShstrtabSection,
+    SectionCount
+};
+
+// Symbol table entries before the globals: the null symbol and the two
+// section symbols that data relocations refer to
+enum : uint32_t { TextSymbol = 1, DataSymbol, FirstGlobal };
+
+// Little-endian fields; the address-sized ones are 4 or 8 bytes wide
+struct ElfWriter {
+    vector<uint8_t>& out;
+    bool elf64;
+
+    void byte(uint8_t b) { out.push_back(b); }
+    void half(uint16_t v) {
+        byte(static_cast<uint8_t>(v));
+        byte(static_cast<uint8_t>(v >> 8));
+    }
+    void word(uint32_t v) {
+        half(static_cast<uint16_t>(v));
+        half(static_cast<uint16_t>(v >> 16));
+    }
+    void xword(uint64_t v) {
+        word(static_cast<uint32_t>(v));
+        word(static_cast<uint32_t>(v >> 32));
+    }
+    void address(uint64_t v) {
+        if (elf64) xword(v);
+        else word(static_cast<uint32_t>(v));
+    }
+    void align(size_t alignment) { out.resize((out.size() + alignment - 1) / alignment * alignment); }
+
+    void symbol(uint32_t name, uint8_t info, uint16_t section, uint64_t value, uint64_t size) {
+        word(name);
+        if (elf64) {
+            byte(info);
+            byte(0);
+            half(section);
+            xword(value);
+            xword(size);
+        } else {
+            address(value);
+            address(size);
+            byte(info);
+            byte(0);
+            half(section);
+        }
+    }
+
+    void section(uint32_t name, uint32_t type, uint64_t flags, uint64_t offset, uint64_t size, uint32_t link,
+                 uint32_t info, uint64_t alignment, uint64_t entrySize) {
+        word(name);
+        word(type);
+        address(flags);
+        address(0);
+        address(offset);
+        address(size);
+        word(link);
+        word(info);
+        address(alignment);
+        address(entrySize);
+    }
+};
+
+static uint32_t addName(string& table, string_view name) {
+    uint32_t offset = table.size();
+    table.append(name);
+    table += '\0';
+    return offset;
+}
+
+void writeObject(const IRModule& module, const MachineCode& code, vector<uint8_t>& object) {
+    bool elf64 = code.target == Target::X64;
+    uint32_t wordSize = elf64 ? 8 : 4;
+    object.clear();
+
+    // Symbols: the module's functions, then the external ones it calls
+    vector<uint8_t> symtab;
+    string strtab(1, '\0');
+    ElfWriter symbols{symtab, elf64};
+    symbols.symbol(0, 0, 0, 0, 0);
+    symbols.symbol(0, STB_LOCAL << 4 | STT_SECTION, TextSection, 0, 0);
+    symbols.symbol(0, STB_LOCAL << 4 | STT_SECTION, DataSection, 0, 0);
+    uint32_t symbolCount = FirstGlobal;
+    for (size_t i = 0; i < module.functions.size(); ++i) {
+        uint32_t start = code.functionOffsets[i];
+        symbols.symbol(addName(strtab, module.functions[i].name), STB_GLOBAL << 4 | STT_FUNC, TextSection, start,
+                       code.functionOffsets[i + 1] - start);
+        symbolCount++;
+    }
+    vector<uint32_t> externalSymbols(module.symbols.size(), 0);
+    for (size_t i = 0; i < module.symbols.size(); ++i) {
+        bool defined = false;
+        for (const IRFunction& function : module.functions) defined = defined || function.name == module.symbols[i];
+        if (defined) continue;
+        symbols.symbol(addName(strtab, module.symbols[i]), STB_GLOBAL << 4 | STT_NOTYPE, 0, 0, 0);
+        externalSymbols[i] = symbolCount++;
+    }
+
+    // Relocations: ELF32 i386 keeps the addends in the text, ELF64 in the
+    // entries
+    vector<uint8_t> text = code.text;
+    vector<uint8_t> relocations;
+    ElfWriter rel{relocations, elf64};
+    for (const Relocation& relocation : code.relocations) {
+        uint32_t symbol = relocation.kind == RelocationKind::Call ? externalSymbols[relocation.symbol] : DataSymbol;
+        uint32_t type;
+        switch (relocation.kind) {
+        case RelocationKind::Data: type = elf64 ? R_X86_64_32 : R_386_32; break;
+        case RelocationKind::DataPc: type = elf64 ? R_X86_64_PC32 : R_386_PC32; break;
+        default: type = elf64 ? R_X86_64_PLT32 : R_386_PC32; break;
+        }
+        if (elf64) {
+            rel.xword(relocation.offset);
+            rel.xword(static_cast<uint64_t>(symbol) << 32 | type);
+            rel.xword(static_cast<uint64_t>(static_cast<int64_t>(relocation.addend)));
+        } else {
+            rel.word(relocation.offset);
+            rel.word(symbol << 8 | type);
+            for (uint32_t k = 0; k < 4; ++k) text[relocation.offset + k] = static_cast<uint8_t>(relocation.addend >> (8 * k));
+        }
+    }
+
+    string shstrtab(1, '\0');
+    uint32_t names[SectionCount] = {};
+    names[TextSection] = addName(shstrtab, ".text");
+    names[DataSection] = addName(shstrtab, ".data");
+    names[SymtabSection] = addName(shstrtab, ".symtab");
+    names[StrtabSection] = addName(shstrtab, ".strtab");
+    names[RelSection] = addName(shstrtab, elf64 ? ".rela.text" : ".rel.text");
+    // An empty .note.GNU-stack asks the linker for a non-executable stack
+    names[NoteSection] = addName(shstrtab, ".note.GNU-stack");
+    names[ShstrtabSection] = addName(shstrtab, ".shstrtab");
+
+    // Contents after the header, then the section header table
+    ElfWriter writer{object, elf64};
+    object.resize(elf64 ? 64 : 52);
+    uint64_t offsets[SectionCount] = {};
+    auto place = [&](uint16_t section, const void* bytes, size_t size, size_t alignment) {
+        writer.align(alignment);
+        offsets[section] = object.size();
+        const uint8_t* begin = static_cast<const uint8_t*>(bytes);
+        object.insert(object.end(), begin, begin + size);
+    };
+    place(TextSection, text.data(), text.size(), 16);
+    place(DataSection, code.data.data(), code.data.size(), 1);
+    place(SymtabSection, symtab.data(), symtab.size(), wordSize);
+    place(StrtabSection, strtab.data(), strtab.size(), 1);
+    place(RelSection, relocations.data(), relocations.size(), wordSize);
+    place(NoteSection, nullptr, 0, 1);
+    place(ShstrtabSection, shstrtab.data(), shstrtab.size(), 1);
+    writer.align(wordSize);
+    uint64_t sectionHeaders = object.size();
+
+    uint32_t symbolSize = elf64 ? 24 : 16;
+    uint32_t relocationSize = elf64 ? 24 : 8;
+    writer.section(0, 0, 0, 0, 0, 0, 0, 0, 0);
+    writer.section(names[TextSection], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, offsets[TextSection], text.size(), 0, 0,
+                   16, 0);
+    writer.section(names[DataSection], SHT_PROGBITS, SHF_WRITE | SHF_ALLOC, offsets[DataSection], code.data.size(), 0,
+                   0, 1, 0);
+    writer.section(names[SymtabSection], SHT_SYMTAB, 0, offsets[SymtabSection], symtab.size(), StrtabSection,
+                   FirstGlobal, wordSize, symbolSize);
+    writer.section(names[StrtabSection], SHT_STRTAB, 0, offsets[StrtabSection], strtab.size(), 0, 0, 1, 0);
+    writer.section(names[RelSection], elf64 ? SHT_RELA : SHT_REL, SHF_INFO_LINK, offsets[RelSection],
+                   relocations.size(), SymtabSection, TextSection, wordSize, relocationSize);
+    writer.section(names[NoteSection], SHT_PROGBITS, 0, offsets[NoteSection], 0, 0, 0, 1, 0);
+    writer.section(names[ShstrtabSection], SHT_STRTAB, 0, offsets[ShstrtabSection], shstrtab.size(), 0, 0, 1, 0);
+
+    // The header, now that the offsets are known
+    vector<uint8_t> header;
+    ElfWriter head{header, elf64};
+    header.insert(header.end(), {0x7F, 'E', 'L', 'F'});
+    head.byte(elf64 ? 2 : 1); // class
+    head.byte(1);             // little-endian
+    head.byte(1);             // version
+    header.resize(16);        // System V ABI, padding
+    head.half(1);             // relocatable
+    head.half(elf64 ? 62 : 3); // EM_X86_64, EM_386
+    head.word(1);
+    head.address(0);          // entry
+    head.address(0);          // program headers
+    head.address(sectionHeaders);
+    head.word(0);             // flags
+    head.half(elf64 ? 64 : 52);
+    head.half(0);
+    head.half(0);
+    head.half(elf64 ? 64 : 40);
+    head.half(SectionCount);
+    head.half(ShstrtabSection);
+    copy(header.begin(), header.end(), object.begin());
+}
@@ -0,0 +1,17 @@
+#ifndef ELF_HPP
+#define ELF_HPP
+
+#include <cstdint>
+#include <vector>
+#include "encoder.hpp"
+#include "ir.hpp"
+using namespace std;
+
+// Relocatable ELF object of an encoded module, for the system linker:
+// ELF32 i386 for Target::X86 and ELF64 x86-64 for Target::X64. Sections
+// are .text, .data with the string literals, the symbol table and the
+// text's relocations. ELF symbols carry the plain C names, without the
+// underscore of the Win32 NASM output.
+void writeObject(const IRModule& module, const MachineCode& code, vector<uint8_t>& object);
+
+#endif // ELF_HPP
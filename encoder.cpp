@@ -0,0 +1,357 @@
+#include "encoder.hpp"
+
+void decodeLiteral(string_view literal, string& bytes) {
+    bytes.clear();
+    for (size_t i = 0; i < literal.size(); ++i) {
+        char c = literal[i];
+        if (c != '\\' || i + 1 == literal.size()) {
+            bytes += c;
+            continue;
+        }
+        // Unknown escapes stand for the character itself, as in gcc
+        switch (c = literal[++i]) {
+        case 'n': bytes += '\n'; break;
+        case 't': bytes += '\t'; break;
+        case 'r': bytes += '\r'; break;
+        case '0': bytes += '\0'; break;
+        default: bytes += c; break;
+        }
+    }
+}
+
+static bool fitsByte(int32_t value) { return value >= -128 && value <= 127; }
+
+static uint8_t low(Reg reg) { return static_cast<uint8_t>(reg) & 7; }
+static bool extended(Reg reg) { return reg != Reg::None && static_cast<uint8_t>(reg) >= 8; }
+
+// Low nibble of the jcc and setcc opcodes
+static uint8_t conditionCode(Cond cond) {
+    static const uint8_t codes[] = {0x4, 0x5, 0xC, 0xE, 0xF, 0xD};
+    return codes[static_cast<int>(cond)];
+}
+
+// Opcode extension in the reg field of the 0x81/0x83 group
+static uint8_t arithmeticExtension(MOp op) {
+    switch (op) {
+    case MOp::Add: return 0;
+    case MOp::And: return 4;
+    case MOp::Sub: return 5;
+    case MOp::Xor: return 6;
+    default: return 7; // Cmp
+    }
+}
+
+// Opcode extension of the 0xC1/0xD1/0xD3 group
+static uint8_t shiftExtension(MOp op) {
+    switch (op) {
+    case MOp::Shl: return 4;
+    case MOp::Shr: return 5;
+    default: return 7; // Sar
+    }
+}
+
+// Encodes one function's instructions at the end of code.text. Jumps and
+// calls are left for the caller to patch.
+struct InstrEncoder {
+    MachineCode& code;
+    const vector<uint32_t>& stringOffsets;
+    bool x64;
+
+    void byte(uint8_t b) { code.text.push_back(b); }
+    void dword(int32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) code.text.push_back(static_cast<uint8_t>(value >> shift));
+    }
+    void relocate(RelocationKind kind, uint32_t symbol, int32_t addend) {
+        code.relocations.push_back({kind, static_cast<uint32_t>(code.text.size()), symbol, addend});
+        dword(0);
+    }
+
+    // 32-bit immediate; a string's address is left to relocation
+    void imm32(const MOperand& operand) {
+        if (operand.kind == MKind::String) relocate(RelocationKind::Data, 0, stringOffsets[operand.value]);
+        else dword(operand.value);
+    }
+
+    // Optional REX prefix, the opcode, then ModRM with reg in its reg field
+    // and rm as a register, memory or, for lea, a rip-relative string.
+    // byteRm: rm is a byte register, and spl-dil exist only with a REX.
+    void instruction(bool wide, initializer_list<uint8_t> opcode, uint8_t reg, const MOperand& rm,
+                     bool byteRm = false) {
+        if (x64) {
+            uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg >= 8 ? 4 : 0);
+            if (rm.isMem() && extended(rm.index)) rex |= 2;
+            if ((rm.isReg() || rm.isMem()) && extended(rm.base)) rex |= 1;
+            bool byteRegister = byteRm && rm.isReg() && low(rm.base) >= 4;
+            if (rex != 0x40 || byteRegister) byte(rex);
+        }
+        for (uint8_t b : opcode) byte(b);
+        reg = (reg & 7) << 3;
+        if (rm.isReg()) {
+            byte(0xC0 | reg | low(rm.base));
+            return;
+        }
+        if (rm.kind == MKind::String) {
+            byte(0x05 | reg);
+            relocate(RelocationKind::DataPc, 0, stringOffsets[rm.value] - 4);
+            return;
+        }
+        int32_t disp = rm.value;
+        uint8_t scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+        uint8_t index = rm.index == Reg::None ? 4 : low(rm.index);
+        if (rm.base == Reg::None) {
+            // Absolute: x86-64 reads mod 00 rm 101 as rip-relative
+            if (rm.index == Reg::None && !x64) {
+                byte(0x05 | reg);
+            } else {
+                byte(0x04 | reg);
+                byte(scale << 6 | index << 3 | 5);
+            }
+            dword(disp);
+            return;
+        }
+        // ebp and r13 have no form without a displacement
+        uint8_t mod = disp == 0 && low(rm.base) != 5 ? 0 : fitsByte(disp) ? 1 : 2;
+        bool sib = rm.index != Reg::None || low(rm.base) == 4;
+        byte(mod << 6 | reg | (sib ? 4 : low(rm.base)));
+        if (sib) byte(scale << 6 | index << 3 | low(rm.base));
+        if (mod == 1) byte(static_cast<uint8_t>(disp));
+        else if (mod == 2) dword(disp);
+    }
+
+    // op rm, imm: the sign-extended byte form when it fits, else the
+    // one-byte-shorter eax form when it applies
+    void immediateForm(bool wide, uint8_t extension, const MOperand& rm, const MOperand& imm) {
+        if (imm.kind == MKind::Imm && fitsByte(imm.value)) {
+            instruction(wide, {0x83}, extension, rm);
+            byte(static_cast<uint8_t>(imm.value));
+        } else if (rm.isReg(Reg::EAX) && !wide) {
+            byte(extension << 3 | 5);
+            imm32(imm);
+        } else {
+            instruction(wide, {0x81}, extension, rm);
+            imm32(imm);
+        }
+    }
+
+    void encode(const MInstr& instr) {
+        const MOperand& dst = instr.dst;
+        const MOperand& src = instr.src;
+        // The stack and frame registers, and string addresses, are 64-bit
+        // on x86-64; everything else computes on 32 bits
+        auto pointer = [](const MOperand& operand) { return operand.isReg(Reg::ESP) || operand.isReg(Reg::EBP); };
+        bool wide = x64 && (pointer(dst) || pointer(src) || (instr.op == MOp::Lea && src.kind == MKind::String));
+        uint8_t dstReg = static_cast<uint8_t>(dst.base);
+        switch (instr.op) {
+        case MOp::Mov:
+            if (dst.isReg() && src.isConstant()) {
+                if (x64 && extended(dst.base)) byte(0x41);
+                byte(0xB8 + low(dst.base));
+                imm32(src);
+            } else if (dst.isReg()) {
+                instruction(wide, {0x8B}, dstReg, src);
+            } else if (src.isReg()) {
+                instruction(wide, {0x89}, static_cast<uint8_t>(src.base), dst);
+            } else {
+                instruction(wide, {0xC7}, 0, dst);
+                imm32(src);
+            }
+            break;
+        case MOp::Movzx: instruction(false, {0x0F, 0xB6}, dstReg, src, true); break;
+        case MOp::Lea: instruction(wide, {0x8D}, dstReg, src); break;
+        case MOp::Add:
+        case MOp::Sub:
+        case MOp::And:
+        case MOp::Xor:
+        case MOp::Cmp: {
+            uint8_t extension = arithmeticExtension(instr.op);
+            if (src.isConstant()) immediateForm(wide, extension, dst, src);
+            else if (dst.isReg()) instruction(wide, {static_cast<uint8_t>(extension << 3 | 3)}, dstReg, src);
+            else instruction(wide, {static_cast<uint8_t>(extension << 3 | 1)}, static_cast<uint8_t>(src.base), dst);
+            break;
+        }
+        case MOp::Test:
+            if (src.isConstant()) {
+                if (dst.isReg(Reg::EAX)) byte(0xA9);
+                else instruction(false, {0xF7}, 0, dst);
+                imm32(src);
+            } else {
+                instruction(false, {0x85}, static_cast<uint8_t>(src.base), dst);
+            }
+            break;
+        case MOp::Imul: {
+            if (src.isNone()) {
+                instruction(false, {0xF7}, 5, dst);
+                break;
+            }
+            // imul r, imm is imul r, r, imm
+            const MOperand& factor = instr.src2.isNone() ? src : instr.src2;
+            const MOperand& rm = instr.src2.isNone() ? dst : src;
+            if (!factor.isConstant()) {
+                instruction(false, {0x0F, 0xAF}, dstReg, src);
+            } else if (factor.kind == MKind::Imm && fitsByte(factor.value)) {
+                instruction(false, {0x6B}, dstReg, rm);
+                byte(static_cast<uint8_t>(factor.value));
+            } else {
+                instruction(false, {0x69}, dstReg, rm);
+                imm32(factor);
+            }
+            break;
+        }
+        case MOp::Neg: instruction(false, {0xF7}, 3, dst); break;
+        case MOp::Idiv: instruction(false, {0xF7}, 7, dst); break;
+        case MOp::Cdq: byte(0x99); break;
+        case MOp::Shl:
+        case MOp::Sar:
+        case MOp::Shr: {
+            uint8_t extension = shiftExtension(instr.op);
+            if (src.isReg()) {
+                instruction(false, {0xD3}, extension, dst); // by cl
+            } else if (src.value == 1) {
+                instruction(false, {0xD1}, extension, dst);
+            } else {
+                instruction(false, {0xC1}, extension, dst);
+                byte(static_cast<uint8_t>(src.value));
+            }
+            break;
+        }
+        case MOp::Setcc: instruction(false, {0x0F, static_cast<uint8_t>(0x90 | conditionCode(instr.cond))}, 0, dst, true); break;
+        // Pushes and pops move a whole stack word without a REX.W
+        case MOp::Push:
+            if (dst.isReg()) {
+                if (x64 && extended(dst.base)) byte(0x41);
+                byte(0x50 + low(dst.base));
+            } else if (dst.kind == MKind::Imm && fitsByte(dst.value)) {
+                byte(0x6A);
+                byte(static_cast<uint8_t>(dst.value));
+            } else if (dst.isConstant()) {
+                byte(0x68);
+                imm32(dst);
+            } else {
+                instruction(false, {0xFF}, 6, dst);
+            }
+            break;
+        case MOp::Pop:
+            if (dst.isReg()) {
+                if (x64 && extended(dst.base)) byte(0x41);
+                byte(0x58 + low(dst.base));
+            } else {
+                instruction(false, {0x8F}, 0, dst);
+            }
+            break;
+        case MOp::Ret: byte(0xC3); break;
+        default: break; // jumps, calls and labels are the function's
+        }
+    }
+};
+
+// A rel8 or rel32 field waiting for its target's offset
+struct BranchFixup {
+    uint32_t instr;  // index into the function's code
+    uint32_t field;  // offset in text
+    uint32_t target; // label, or function index for calls
+};
+
+static void encodeFunction(const IRModule& module, const MFunction& function, InstrEncoder& encoder,
+                           vector<BranchFixup>& calls) {
+    MachineCode& code = encoder.code;
+    const vector<MInstr>& instrs = function.code;
+    uint32_t start = code.text.size();
+    size_t relocationCount = code.relocations.size();
+    size_t callCount = calls.size();
+    vector<uint32_t> labelAt(function.exitLabel + 1, 0);
+    vector<bool> near(instrs.size(), false); // jumps that need rel32
+    vector<BranchFixup> jumps;
+    // Every jump starts short; one found out of reach grows, and the
+    // function is encoded again until all fit
+    for (bool grown = true; grown;) {
+        code.text.resize(start);
+        code.relocations.resize(relocationCount);
+        calls.resize(callCount);
+        jumps.clear();
+        for (uint32_t i = 0; i < instrs.size(); ++i) {
+            const MInstr& instr = instrs[i];
+            switch (instr.op) {
+            case MOp::Label: labelAt[instr.dst.value] = code.text.size(); break;
+            case MOp::Jmp:
+            case MOp::Jcc: {
+                uint8_t cc = conditionCode(instr.cond);
+                if (instr.op == MOp::Jmp) {
+                    encoder.byte(near[i] ? 0xE9 : 0xEB);
+                } else if (near[i]) {
+                    encoder.byte(0x0F);
+                    encoder.byte(0x80 | cc);
+                } else {
+                    encoder.byte(0x70 | cc);
+                }
+                jumps.push_back({i, static_cast<uint32_t>(code.text.size()), static_cast<uint32_t>(instr.dst.value)});
+                if (near[i]) encoder.dword(0);
+                else encoder.byte(0);
+                break;
+            }
+            case MOp::Call: {
+                encoder.byte(0xE8);
+                string_view name = module.symbols[instr.dst.value];
+                uint32_t callee = 0;
+                while (callee < module.functions.size() && module.functions[callee].name != name) callee++;
+                if (callee < module.functions.size()) {
+                    calls.push_back({i, static_cast<uint32_t>(code.text.size()), callee});
+                    encoder.dword(0);
+                } else {
+                    encoder.relocate(RelocationKind::Call, instr.dst.value, -4);
+                }
+                break;
+            }
+            default: encoder.encode(instr); break;
+            }
+        }
+        grown = false;
+        for (const BranchFixup& jump : jumps) {
+            int64_t disp = static_cast<int64_t>(labelAt[jump.target]) - static_cast<int64_t>(jump.field + 1);
+            if (!near[jump.instr] && (disp < -128 || disp > 127)) near[jump.instr] = grown = true;
+        }
+    }
+    for (const BranchFixup& jump : jumps) {
+        uint32_t width = near[jump.instr] ? 4 : 1;
+        int32_t disp = static_cast<int32_t>(labelAt[jump.target] - (jump.field + width));
+        for (uint32_t k = 0; k < width; ++k) code.text[jump.field + k] = static_cast<uint8_t>(disp >> (8 * k));
+    }
+}
+
+void encodeModule(const IRModule& module, const vector<MFunction>& functions, MachineCode& code) {
+    code.target = functions.empty() ? Target::X86 : functions[0].target;
+    code.text.clear();
+    code.data.clear();
+    code.functionOffsets.clear();
+    code.relocations.clear();
+
+    // Data: the literals the code still refers to, NUL-terminated, in the
+    // order of the NASM data section
+    vector<uint32_t> stringOffsets(module.strings.size(), UINT32_MAX);
+    for (const MFunction& function : functions) {
+        for (const MInstr& instr : function.code) {
+            for (const MOperand& operand : {instr.dst, instr.src}) {
+                if (operand.kind == MKind::String) stringOffsets[operand.value] = 0;
+            }
+        }
+    }
+    string bytes;
+    for (size_t i = 0; i < module.strings.size(); ++i) {
+        if (stringOffsets[i] == UINT32_MAX) continue;
+        stringOffsets[i] = code.data.size();
+        decodeLiteral(module.strings[i], bytes);
+        code.data.insert(code.data.end(), bytes.begin(), bytes.end());
+        code.data.push_back(0);
+    }
+
+    InstrEncoder encoder{code, stringOffsets, code.target == Target::X64};
+    vector<BranchFixup> calls;
+    for (const MFunction& function : functions) {
+        code.functionOffsets.push_back(code.text.size());
+        encodeFunction(module, function, encoder, calls);
+    }
+    code.functionOffsets.push_back(code.text.size());
+    for (const BranchFixup& call : calls) {
+        int32_t disp = static_cast<int32_t>(code.functionOffsets[call.target] - (call.field + 4));
+        for (uint32_t k = 0; k < 4; ++k) code.text[call.field + k] = static_cast<uint8_t>(disp >> (8 * k));
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef ENCODER_HPP
+#define ENCODER_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ir.hpp"
+#include "x86.hpp"
+using namespace std;
+
+// A 32-bit field of the text that is known only once the text and data
+// are placed in memory: what NASM would leave to the linker
+enum class RelocationKind : uint8_t {
+    Data,      // address of data + addend
+    DataPc,    // data + addend relative to the field, for rip-relative lea
+    Call       // external symbol relative to the field, through the PLT on x86-64
+};
+
+struct Relocation {
+    RelocationKind kind;
+    uint32_t offset;  // of the field in text
+    uint32_t symbol;  // Call: index into IRModule::symbols
+    int32_t addend;   // Data and DataPc: offset into data; PC-relative ones less 4
+};
+
+// Machine code of a module: the functions back to back in one text
+// section, and the string literals they use in one data section. Calls
+// between the module's own functions are resolved; relocations remain
+// for string addresses and external calls.
+struct MachineCode {
+    Target target = Target::X86;
+    vector<uint8_t> text;
+    vector<uint8_t> data;
+    vector<uint32_t> functionOffsets; // start of each function in text, then its end
+    vector<Relocation> relocations;
+};
+
+// Bytes of a string literal as written in the source, escapes and all
+void decodeLiteral(string_view literal, string& bytes);
+
+// Jumps take the two-byte short form when their target is in reach.
+void encodeModule(const IRModule& module, const vector<MFunction>& functions, MachineCode& code);
+
+#endif // ENCODER_HPP
@@ -0,0 +1,88 @@
+#include "f4.h"
+#include "pipeline.hpp"
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <streambuf>
+
+// Writes into the caller's buffer as far as it goes, and counts the rest
+struct CallerBuffer : streambuf {
+    char* output;
+    size_t capacity;
+    size_t size = 0;
+
+    CallerBuffer(char* output, size_t capacity) : output(output), capacity(capacity) {}
+
+    streamsize xsputn(const char* data, streamsize count) override {
+        if (size < capacity) memcpy(output + size, data, min<size_t>(count, capacity - size));
+        size += count;
+        return count;
+    }
+    int overflow(int c) override {
+        if (c == traits_type::eof()) return traits_type::not_eof(c);
+        char byte = static_cast<char>(c);
+        xsputn(&byte, 1);
+        return c;
+    }
+};
+
+static bool toOptions(const f4_options* options, CompileOptions& compileOptions) {
+    // Callers compile on many threads at once
+    compileOptions = pooledOptions(compileOptions);
+    if (!options) return true;
+    if (options->emit & ~(F4_EMIT_TOKENS | F4_EMIT_AST | F4_EMIT_TAC | F4_EMIT_ASM)) return false;
+    compileOptions.optimize = options->optimize != 0;
+    compileOptions.target = options->x86_64 ? Target::X64 : Target::X86;
+    compileOptions.interpret = options->interpret != 0;
+    compileOptions.emit = static_cast<uint8_t>(options->emit);
+    string reason;
+    return checkOptions(compileOptions, reason);
+}
+
+static int finish(const CallerBuffer& buffer, size_t* size, int status) {
+    *size = buffer.size;
+    if (buffer.size > buffer.capacity) return F4_TRUNCATED;
+    return status == 0 ? F4_OK : F4_FAILED;
+}
+
+// Nothing may be thrown across the C interface; the pipeline itself only
+// throws when memory runs out
+extern "C" int f4_compile(const char* source, size_t sourceSize, const f4_options* options, char* output,
+                          size_t capacity, size_t* size) {
+    CompileOptions compileOptions;
+    if ((!source && sourceSize) || (!output && capacity) || !size || !toOptions(options, compileOptions)) {
+        return F4_INVALID;
+    }
+    try {
+        CallerBuffer buffer(output, capacity);
+        ostream out(&buffer);
+        int status = compile(string_view(source, sourceSize), compileOptions, out);
+        return finish(buffer, size, status);
+    } catch (const bad_alloc&) {
+        return F4_INVALID;
+    }
+}
+
+extern "C" int f4_object(const char* source, size_t sourceSize, const f4_options* options, char* output,
+                         size_t capacity, size_t* size) {
+    CompileOptions compileOptions;
+    if ((!source && sourceSize) || (!output && capacity) || !size || !toOptions(options, compileOptions)) {
+        return F4_INVALID;
+    }
+    try {
+        vector<uint8_t> object;
+        vector<string> errors;
+        CallerBuffer buffer(output, capacity);
+        if (!compileObject(string_view(source, sourceSize), compileOptions, object, errors)) {
+            for (const string& error : errors) {
+                buffer.xsputn(error.data(), error.size());
+                buffer.xsputn("\n", 1);
+            }
+            return finish(buffer, size, 1);
+        }
+        buffer.xsputn(reinterpret_cast<const char*>(object.data()), object.size());
+        return finish(buffer, size, 0);
+    } catch (const bad_alloc&) {
+        return F4_INVALID;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef F4_H
+#define F4_H
+
+// libf4: the compiler as a library, behind a C interface. Sources are
+// read from memory and results written into buffers the caller owns.
+// The library keeps no state between calls, so any number of calls may
+// run at once on different threads.
+//
+//   g++ -std=c++17 -O2 -fPIC -fvisibility=hidden -shared -pthread $(ls *.cpp | grep -v main.cpp) -o libf4.so
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define F4_API __attribute__((visibility("default")))
+#else
+#define F4_API
+#endif
+
+// Results of the calls below
+#define F4_OK 0         // compiled, and ran if asked to
+#define F4_FAILED 1     // the source has errors, or its run failed
+#define F4_TRUNCATED 2  // the buffer was too small: *size is what it needs
+#define F4_INVALID (-1) // bad arguments, or out of memory
+
+// Phases for f4_options.emit, as for --emit
+#define F4_EMIT_TOKENS 1u
+#define F4_EMIT_AST 2u
+#define F4_EMIT_TAC 4u
+#define F4_EMIT_ASM 8u
+
+typedef struct f4_options {
+    int optimize;  // -O
+    int x86_64;    // -m64: x86-64 System V rather than 32-bit x86
+    int interpret; // --interpret
+    unsigned emit; // F4_EMIT_* bits: the JSON document; 0 for the text report
+} f4_options;
+
+// Compiles source and writes the report the command line would print,
+// text or JSON as options->emit asks, to output. options may be NULL for
+// the defaults. *size is set to the report's full length; when that is
+// more than capacity, output holds only its first capacity bytes and the
+// call returns F4_TRUNCATED. The report is not NUL-terminated.
+F4_API int f4_compile(const char* source, size_t sourceSize, const f4_options* options, char* output,
+                      size_t capacity, size_t* size);
+
+// Compiles source to an ELF relocatable object, written to output. When
+// the source has errors they are written there instead, one per line,
+// and the call returns F4_FAILED. *size and F4_TRUNCATED as above.
+F4_API int f4_object(const char* source, size_t sourceSize, const f4_options* options, char* output,
+                     size_t capacity, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // F4_H
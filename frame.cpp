@@ -0,0 +1,27 @@
+#include "frame.hpp"
+
+MOperand FrameLayout::slot(uint32_t index) const {
+    return MOperand::mem(Reg::EBP, -static_cast<int32_t>(wordSize * saved.size() + 4 * (index + 1)));
+}
+
+uint32_t FrameLayout::callPadding(size_t pushedArguments) const {
+    return (stackAlignment - wordSize * pushedArguments % stackAlignment) % stackAlignment;
+}
+
+void layoutFrame(const RegisterAllocation& allocation, const CallingConvention& convention, bool makesCalls,
+                 FrameLayout& frame) {
+    frame.wordSize = convention.wordSize;
+    frame.saved.clear();
+    for (uint32_t reg = 0; reg < static_cast<uint32_t>(Reg::None); ++reg) {
+        uint16_t bit = regBit(static_cast<Reg>(reg));
+        if (allocation.usedRegisters & convention.calleeSaved & bit) frame.saved.push_back(static_cast<Reg>(reg));
+    }
+    frame.slotCount = allocation.slotCount;
+    frame.reserved = 4 * frame.slotCount;
+    if (!makesCalls) return;
+    // The caller's call pushed the return address on an aligned stack, and
+    // the prologue pushes ebp and the saved registers
+    uint32_t pushed = frame.wordSize * (2 + frame.saved.size());
+    uint32_t total = pushed + frame.reserved;
+    frame.reserved += (stackAlignment - total % stackAlignment) % stackAlignment;
+}
@@ -0,0 +1,36 @@
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "regalloc.hpp"
+#include "x86.hpp"
+using namespace std;
+
+// x86-64 System V, i386 System V and gcc's default for Win32: the stack
+// pointer is 16-byte aligned at every call instruction
+const uint32_t stackAlignment = 16;
+
+// Stack frame of one function. Below the saved ebp come the callee-saved
+// registers the allocator used, then the 4-byte spill slots of the
+// temporaries and variables not kept in registers, then padding. The
+// prologue reserves the slots and padding with a single sub esp.
+struct FrameLayout {
+    uint32_t wordSize = 4; // bytes per push
+    vector<Reg> saved;     // in push order
+    uint32_t slotCount = 0;
+    uint32_t reserved = 0; // bytes for slots and padding
+
+    MOperand slot(uint32_t index) const;
+    // Bytes to reserve before pushing that many arguments, so that the
+    // call happens on an aligned stack
+    uint32_t callPadding(size_t pushedArguments) const;
+};
+
+// makesCalls: whether the function calls out; leaf functions skip the
+// padding
+void layoutFrame(const RegisterAllocation& allocation, const CallingConvention& convention, bool makesCalls,
+                 FrameLayout& frame);
+
+#endif // FRAME_HPP
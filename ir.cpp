@@ -0,0 +1,126 @@
+#include "ir.hpp"
+#include <algorithm>
+
+bool isBinary(Opcode op) {
+    return op >= Opcode::Add && op <= Opcode::CmpGe;
+}
+
+bool isCompare(Opcode op) {
+    return op >= Opcode::CmpEq && op <= Opcode::CmpGe;
+}
+
+const char* opcodeSymbol(Opcode op) {
+    switch (op) {
+        case Opcode::Add: return "+";
+        case Opcode::Sub: return "-";
+        case Opcode::Mul: return "*";
+        case Opcode::Div: return "/";
+        case Opcode::Mod: return "%";
+        case Opcode::CmpEq: return "==";
+        case Opcode::CmpNe: return "!=";
+        case Opcode::CmpLt: return "<";
+        case Opcode::CmpLe: return "<=";
+        case Opcode::CmpGt: return ">";
+        case Opcode::CmpGe: return ">=";
+        default: return "?";
+    }
+}
+
+bool evaluateBinary(Opcode op, int32_t a, int32_t b, int32_t& result) {
+    // Unsigned arithmetic gives the two's complement wraparound the target
+    // produces, without undefined behaviour in the compiler itself
+    uint32_t ua = static_cast<uint32_t>(a), ub = static_cast<uint32_t>(b);
+    switch (op) {
+        case Opcode::Add: result = static_cast<int32_t>(ua + ub); return true;
+        case Opcode::Sub: result = static_cast<int32_t>(ua - ub); return true;
+        case Opcode::Mul: result = static_cast<int32_t>(ua * ub); return true;
+        case Opcode::Div:
+            if (b == 0 || (a == INT32_MIN && b == -1)) return false;
+            result = a / b;
+            return true;
+        case Opcode::Mod:
+            if (b == 0 || (a == INT32_MIN && b == -1)) return false;
+            result = a % b;
+            return true;
+        case Opcode::CmpEq: result = a == b; return true;
+        case Opcode::CmpNe: result = a != b; return true;
+        case Opcode::CmpLt: result = a < b; return true;
+        case Opcode::CmpLe: result = a <= b; return true;
+        case Opcode::CmpGt: result = a > b; return true;
+        case Opcode::CmpGe: result = a >= b; return true;
+        default: return false;
+    }
+}
+
+Operand IRFunction::newLabel() {
+    labels.push_back(UINT32_MAX); // not placed yet
+    return Operand::label(labels.size() - 1);
+}
+
+void IRFunction::placeLabel(Operand label) {
+    labels[label.id()] = code.size();
+    emit(Opcode::Label, {}, label);
+}
+
+void IRFunction::rebuildLabelTable() {
+    fill(labels.begin(), labels.end(), UINT32_MAX);
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].op == Opcode::Label) labels[code[i].a.id()] = i;
+    }
+}
+
+uint32_t IRModule::internVar(string_view name) {
+    auto [it, inserted] = varIds.try_emplace(name, vars.size());
+    if (inserted) vars.push_back(name);
+    return it->second;
+}
+
+uint32_t IRModule::addString(string_view text) {
+    strings.push_back(text);
+    return strings.size() - 1;
+}
+
+uint32_t IRModule::internSymbol(string_view name) {
+    auto [it, inserted] = symbolIds.try_emplace(name, symbols.size());
+    if (inserted) symbols.push_back(name);
+    return it->second;
+}
+
+string formatOperand(const IRModule& module, Operand operand) {
+    switch (operand.kind) {
+        case OperandKind::None: return "";
+        case OperandKind::Temp: return "T" + to_string(operand.id() + 1);
+        case OperandKind::Var:
+            if (operand.version) return string(module.vars[operand.id()]) + "." + to_string(operand.version);
+            return string(module.vars[operand.id()]);
+        case OperandKind::Const: return to_string(operand.value);
+        case OperandKind::String: return "\"" + string(module.strings[operand.id()]) + "\"";
+        case OperandKind::Label: return "L" + to_string(operand.id() + 1);
+        case OperandKind::Symbol: return string(module.symbols[operand.id()]);
+    }
+    return "";
+}
+
+string formatQuad(const IRModule& module, const Quad& quad) {
+    auto f = [&](Operand operand) { return formatOperand(module, operand); };
+    switch (quad.op) {
+        case Opcode::Copy: return f(quad.dst) + " = " + f(quad.a);
+        case Opcode::Param: return "param " + f(quad.a);
+        case Opcode::Call:
+            if (quad.dst.isNone()) return "call " + f(quad.a) + ", " + f(quad.b);
+            return f(quad.dst) + " = call " + f(quad.a) + ", " + f(quad.b);
+        case Opcode::Return: return "return " + f(quad.a);
+        case Opcode::IfNot: return "ifnot " + f(quad.a) + " goto " + f(quad.b);
+        case Opcode::Goto: return "goto " + f(quad.a);
+        case Opcode::Label: return f(quad.a) + ":";
+        default: return f(quad.dst) + " = " + f(quad.a) + " " + opcodeSymbol(quad.op) + " " + f(quad.b);
+    }
+}
+
+void formatIR(const IRModule& module, vector<string>& lines) {
+    for (const IRFunction& function : module.functions) {
+        lines.push_back("func " + string(function.name));
+        for (const Quad& quad : function.code) lines.push_back(formatQuad(module, quad));
+        lines.push_back("endfunc");
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Three-address code. Each instruction is a fixed-size Quad whose operands
+// are small tagged IDs; names and string literals live in side tables on
+// the module and text is only produced by formatIR().
+
+enum class Opcode : uint8_t {
+    Copy,                                   // dst = a
+    Add, Sub, Mul, Div, Mod,                // dst = a op b
+    CmpEq, CmpNe, CmpLt, CmpLe, CmpGt, CmpGe, // dst = a op b, 1 or 0
+    Param,                                  // param a
+    Call,                                   // [dst =] call a, b (b = argument count)
+    Return,                                 // return a
+    IfNot,                                  // ifnot a goto b
+    Goto,                                   // goto a
+    Label                                   // a:
+};
+
+enum class OperandKind : uint8_t {
+    None,
+    Temp,     // compiler temporary, numbered per function
+    Var,      // source variable, index into IRModule::vars
+    Const,    // 32-bit integer constant
+    String,   // string literal, index into IRModule::strings
+    Label,    // jump target, numbered per function
+    Symbol    // called function, index into IRModule::symbols
+};
+
+struct Operand {
+    OperandKind kind = OperandKind::None;
+    uint32_t version = 0; // SSA version of a Var, 0 outside SSA form
+    int32_t value = 0;
+
+    static Operand temp(uint32_t id) { return {OperandKind::Temp, 0, static_cast<int32_t>(id)}; }
+    static Operand var(uint32_t id) { return {OperandKind::Var, 0, static_cast<int32_t>(id)}; }
+    static Operand constant(int32_t value) { return {OperandKind::Const, 0, value}; }
+    static Operand string(uint32_t id) { return {OperandKind::String, 0, static_cast<int32_t>(id)}; }
+    static Operand label(uint32_t id) { return {OperandKind::Label, 0, static_cast<int32_t>(id)}; }
+    static Operand symbol(uint32_t id) { return {OperandKind::Symbol, 0, static_cast<int32_t>(id)}; }
+
+    bool isNone() const { return kind == OperandKind::None; }
+    uint32_t id() const { return static_cast<uint32_t>(value); }
+    bool operator==(const Operand& other) const {
+        return kind == other.kind && value == other.value && version == other.version;
+    }
+    bool operator!=(const Operand& other) const { return !(*this == other); }
+};
+
+struct Quad {
+    Opcode op;
+    Operand dst;
+    Operand a;
+    Operand b;
+};
+
+bool isBinary(Opcode op);
+bool isCompare(Opcode op);
+const char* opcodeSymbol(Opcode op); // "+", "==", ... for binary opcodes
+// Computes a binary operation with C's 32-bit int semantics: arithmetic
+// wraps, division truncates toward zero. Returns false for division by zero
+// and INT_MIN / -1, which have no defined result.
+bool evaluateBinary(Opcode op, int32_t a, int32_t b, int32_t& result);
+
+struct IRFunction {
+    string_view name;
+    vector<Quad> code;
+    uint32_t tempCount = 0;
+    vector<uint32_t> labels; // label ID -> index of its Label quad
+
+    Operand newTemp() { return Operand::temp(tempCount++); }
+    Operand newLabel();
+    void emit(Opcode op, Operand dst = {}, Operand a = {}, Operand b = {}) { code.push_back({op, dst, a, b}); }
+    void placeLabel(Operand label);
+    // Recomputes label positions after a pass has moved or removed quads
+    void rebuildLabelTable();
+};
+
+struct IRModule {
+    vector<IRFunction> functions;
+    vector<string_view> vars;
+    vector<string_view> strings;
+    vector<string_view> symbols;
+
+    uint32_t internVar(string_view name);
+    uint32_t addString(string_view text);
+    uint32_t internSymbol(string_view name);
+
+private:
+    unordered_map<string_view, uint32_t> varIds;
+    unordered_map<string_view, uint32_t> symbolIds;
+};
+
+string formatOperand(const IRModule& module, Operand operand);
+string formatQuad(const IRModule& module, const Quad& quad);
+// One line per instruction, bracketed by "func name" / "endfunc"
+void formatIR(const IRModule& module, vector<string>& lines);
+
+#endif // IR_HPP
@@ -0,0 +1,175 @@
+#include "jit.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// jmp [rip+2]; two int3 of padding; the target's 8-byte address
+static const size_t stubSize = 16;
+
+static size_t roundUp(size_t size, size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+static void patch32(uint8_t* field, uint32_t value) { memcpy(field, &value, 4); }
+
+// Set by the child once main has returned, in memory shared with the parent
+struct ChildResult {
+    volatile int32_t returned;
+    volatile int32_t value;
+};
+
+bool runInMemory(const IRModule& module, const MachineCode& code, uint32_t timeoutMs, RunResult& result) {
+    result = RunResult();
+    if (code.target != Target::X64) {
+        result.error = "in-memory execution needs x86-64 code";
+        return false;
+    }
+    uint32_t mainIndex = 0;
+    while (mainIndex < module.functions.size() && module.functions[mainIndex].name != "main") mainIndex++;
+    if (mainIndex == module.functions.size()) {
+        result.error = "no function 'main' to run";
+        return false;
+    }
+
+    // One stub per external symbol the code calls
+    vector<uint32_t> stubOf(module.symbols.size(), UINT32_MAX);
+    vector<void*> targets;
+    for (const Relocation& relocation : code.relocations) {
+        if (relocation.kind != RelocationKind::Call || stubOf[relocation.symbol] != UINT32_MAX) continue;
+        string name(module.symbols[relocation.symbol]);
+        void* address = dlsym(RTLD_DEFAULT, name.c_str());
+        if (!address) {
+            result.error = "unresolved symbol '" + name + "'";
+            return false;
+        }
+        stubOf[relocation.symbol] = targets.size();
+        targets.push_back(address);
+    }
+
+    // Text and stubs on executable pages, data on writable ones after them
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t stubsAt = roundUp(code.text.size(), stubSize);
+    size_t codeBytes = roundUp(stubsAt + stubSize * targets.size(), page);
+    size_t dataBytes = roundUp(code.data.size() + 1, page);
+    void* region = mmap(nullptr, codeBytes + dataBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT,
+                        -1, 0);
+    if (region == MAP_FAILED) {
+        result.error = string("cannot map code: ") + strerror(errno);
+        return false;
+    }
+    uint8_t* text = static_cast<uint8_t*>(region);
+    uint8_t* stubs = text + stubsAt;
+    uint8_t* data = text + codeBytes;
+    memcpy(text, code.text.data(), code.text.size());
+    memcpy(data, code.data.data(), code.data.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        static const uint8_t jump[8] = {0xFF, 0x25, 0x02, 0x00, 0x00, 0x00, 0xCC, 0xCC};
+        memcpy(stubs + stubSize * i, jump, sizeof(jump));
+        memcpy(stubs + stubSize * i + sizeof(jump), &targets[i], sizeof(void*));
+    }
+    for (const Relocation& relocation : code.relocations) {
+        uint8_t* field = text + relocation.offset;
+        intptr_t value;
+        switch (relocation.kind) {
+        case RelocationKind::Data: value = reinterpret_cast<intptr_t>(data) + relocation.addend; break;
+        case RelocationKind::DataPc:
+            value = reinterpret_cast<intptr_t>(data) + relocation.addend - reinterpret_cast<intptr_t>(field);
+            break;
+        default:
+            value = reinterpret_cast<intptr_t>(stubs + stubSize * stubOf[relocation.symbol]) + relocation.addend -
+                    reinterpret_cast<intptr_t>(field);
+            break;
+        }
+        patch32(field, static_cast<uint32_t>(value));
+    }
+
+    // The output ends when the child's end of the pipe closes. Another
+    // child forked meanwhile would inherit that end, since children here
+    // never exec, and hold it open until it exits: one run at a time, as
+    // the command line allows, keeps that from happening. Close-on-exec
+    // still keeps the pipe out of any program the host process execs.
+    int pipeFds[2];
+    void* shared = mmap(nullptr, sizeof(ChildResult), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mprotect(text, codeBytes, PROT_READ | PROT_EXEC) != 0 || shared == MAP_FAILED || pipe2(pipeFds, O_CLOEXEC) != 0) {
+        result.error = string("cannot prepare the run: ") + strerror(errno);
+        if (shared != MAP_FAILED) munmap(shared, sizeof(ChildResult));
+        munmap(region, codeBytes + dataBytes);
+        return false;
+    }
+    ChildResult* child = new (shared) ChildResult{0, 0};
+
+    // The child inherits stdio's buffers: empty them first
+    fflush(nullptr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipeFds[0]);
+        dup2(pipeFds[1], STDOUT_FILENO);
+        close(pipeFds[1]);
+        // Whole lines reach the parent even if the program crashes
+        setvbuf(stdout, nullptr, _IOLBF, BUFSIZ);
+        auto entry = reinterpret_cast<int32_t (*)()>(text + code.functionOffsets[mainIndex]);
+        int32_t value = entry();
+        fflush(stdout);
+        child->value = value;
+        child->returned = 1;
+        _exit(0);
+    }
+    close(pipeFds[1]);
+    bool timedOut = false;
+    if (pid < 0) {
+        result.error = string("cannot fork: ") + strerror(errno);
+    } else {
+        // Collect the output until the child closes the pipe or time runs out
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        char buffer[4096];
+        for (;;) {
+            auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            pollfd readable = {pipeFds[0], POLLIN, 0};
+            if (left <= 0 || poll(&readable, 1, static_cast<int>(left)) == 0) {
+                timedOut = true;
+                kill(pid, SIGKILL);
+                break;
+            }
+            ssize_t count = read(pipeFds[0], buffer, sizeof(buffer));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) break;
+            result.output.append(buffer, count);
+        }
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        if (child->returned) {
+            result.completed = true;
+            result.returnValue = child->value;
+        } else if (timedOut) {
+            result.error = "timed out after " + to_string(timeoutMs) + " ms";
+        } else if (WIFSIGNALED(status)) {
+            result.error = string("terminated by signal ") + to_string(WTERMSIG(status)) + " (" +
+                           strsignal(WTERMSIG(status)) + ")";
+        } else {
+            result.error = "exited without returning from main";
+        }
+    }
+    close(pipeFds[0]);
+    munmap(shared, sizeof(ChildResult));
+    munmap(region, codeBytes + dataBytes);
+    return pid >= 0;
+}
+
+#else
+
+bool runInMemory(const IRModule&, const MachineCode&, uint32_t, RunResult& result) {
+    result = RunResult();
+    result.error = "in-memory execution needs an x86-64 Linux host";
+    return false;
+}
+
+#endif
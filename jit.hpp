@@ -0,0 +1,29 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstdint>
+#include <string>
+#include "encoder.hpp"
+#include "ir.hpp"
+using namespace std;
+
+struct RunResult {
+    bool completed = false; // main returned within the time limit
+    int32_t returnValue = 0;
+    string output;          // what the program wrote to stdout
+    string error;           // why it did not run or complete
+};
+
+// Runs encoded x86-64 code in memory. Text and data are copied into pages
+// in the low 2 GB, since the code may address strings with 32-bit
+// immediates, and external calls are bound through jump stubs to the
+// host's own symbols: printf is the host libc's. The text is then made
+// executable and main is called in a forked child, so that a crash or a
+// runaway recursion cannot take the compiler down; the child's stdout
+// is captured through a pipe, and it is killed after timeoutMs. Not for
+// concurrent use: a run forked meanwhile would inherit this one's pipe
+// and delay the end of its output. Returns false when the code cannot
+// be run at all.
+bool runInMemory(const IRModule& module, const MachineCode& code, uint32_t timeoutMs, RunResult& result);
+
+#endif // JIT_HPP
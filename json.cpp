@@ -0,0 +1,101 @@
+#include "json.hpp"
+#include <charconv>
+
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!first.back()) buffer += ',';
+    first.back() = false;
+}
+
+void JsonWriter::open(char bracket) {
+    separate();
+    buffer += bracket;
+    first.push_back(true);
+}
+
+void JsonWriter::close(char bracket) {
+    buffer += bracket;
+    first.pop_back();
+}
+
+void JsonWriter::key(string_view name) {
+    separate();
+    buffer += '"';
+    buffer += name;
+    buffer += "\":";
+    afterKey = true;
+}
+
+void JsonWriter::value(string_view text) {
+    separate();
+    quoted(text);
+}
+
+void JsonWriter::value(int64_t number) {
+    separate();
+    char digits[24];
+    buffer.append(digits, to_chars(digits, digits + sizeof(digits), number).ptr);
+}
+
+void JsonWriter::value(bool flag) {
+    separate();
+    buffer += flag ? "true" : "false";
+}
+
+// Length of the well-formed UTF-8 sequence at text[i], or 0
+static size_t utf8Length(string_view text, size_t i) {
+    uint8_t lead = text[i];
+    size_t length = lead >= 0xF0 && lead <= 0xF4 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 && lead < 0xE0 ? 2 : 0;
+    if (!length || i + length > text.size()) return 0;
+    for (size_t k = 1; k < length; ++k) {
+        if ((static_cast<uint8_t>(text[i + k]) & 0xC0) != 0x80) return 0;
+    }
+    uint8_t second = text[i + 1];
+    // Overlong forms, surrogates and code points past U+10FFFF
+    if ((lead == 0xE0 && second < 0xA0) || (lead == 0xED && second >= 0xA0) || (lead == 0xF0 && second < 0x90) ||
+        (lead == 0xF4 && second >= 0x90)) {
+        return 0;
+    }
+    return length;
+}
+
+void JsonWriter::quoted(string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    buffer += '"';
+    size_t run = 0; // start of the bytes that need no escaping
+    for (size_t i = 0; i < text.size();) {
+        uint8_t c = text[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+            i++;
+            continue;
+        }
+        size_t length = c >= 0x80 ? utf8Length(text, i) : 0;
+        if (length) {
+            i += length;
+            continue;
+        }
+        buffer.append(text.data() + run, i - run);
+        switch (c) {
+        case '"': buffer += "\\\""; break;
+        case '\\': buffer += "\\\\"; break;
+        case '\n': buffer += "\\n"; break;
+        case '\r': buffer += "\\r"; break;
+        case '\t': buffer += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                buffer += "\\u00";
+                buffer += hex[c >> 4];
+                buffer += hex[c & 15];
+            } else {
+                buffer += "\xEF\xBF\xBD";
+            }
+            break;
+        }
+        run = ++i;
+    }
+    buffer.append(text.data() + run, text.size() - run);
+    buffer += '"';
+}
@@ -0,0 +1,38 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Compact JSON built up in one string and written out in one go. Commas
+// are placed by the writer: inside an object, call key() before each
+// value. Keys are the caller's own plain ASCII names and go out as they
+// are; string values are escaped, and bytes that are not valid UTF-8
+// become U+FFFD, so the document is always well formed.
+struct JsonWriter {
+    string buffer;
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+    void key(string_view name);
+    void value(string_view text);
+    void value(const char* text) { value(string_view(text)); }
+    void value(int64_t number);
+    void value(bool flag);
+
+private:
+    void separate();
+    void open(char bracket);
+    void close(char bracket);
+    void quoted(string_view text);
+
+    vector<bool> first{true}; // per open container: nothing in it yet
+    bool afterKey = false;
+};
+
+#endif // JSON_HPP
@@ -1,113 +1,347 @@
 #include "lexer.hpp"
-#include <regex>
-#include <cctype>
-
-void tokenize(const string& source, vector<Token>& tokens, vector<string>& errors) {
-    vector<pair<string, TokenType>> tokenSpecs = {
-        {"int", TokenType::INT},
-        {"return", TokenType::RETURN},
-        {"if", TokenType::IF},
-        {"else", TokenType::ELSE},
-        {"==", TokenType::COMPARE},
-        {"!=", TokenType::COMPARE},
-        {"<=", TokenType::COMPARE},
-        {">=", TokenType::COMPARE},
-        {"<", TokenType::COMPARE},
-        {">", TokenType::COMPARE},
-        {"=", TokenType::ASSIGN},
-        {"[+*/\-]", TokenType::OP},
-        {"\\(", TokenType::LPAREN},
-        {"\\)", TokenType::RPAREN},
-        {"\\{", TokenType::LBRACE},
-        {"\\}", TokenType::RBRACE},
-        {";", TokenType::SEMI},
-        {",", TokenType::COMMA},
-        {"[0-9]+", TokenType::NUMBER},
-        {"[a-zA-Z_][a-zA-Z0-9_]*", TokenType::ID},
-    };
-    size_t pos = 0;
-    int line = 1;
-    int lineStart = 0;
-    while (pos < source.length()) {
-        // Skip whitespace
-        while (pos < source.length() && isspace(source[pos])) {
-            if (source[pos] == '\n') {
-                line++;
-                lineStart = pos + 1;
-            }
-            pos++;
-        }
-        if (pos >= source.length()) break;
-        // Skip preprocessor directives
-        if (source[pos] == '#') {
-            while (pos < source.length() && source[pos] != '\n') pos++;
-            continue;
-        }
-        // Skip single-line comments
-        if (source.substr(pos, 2) == "//") {
-            pos += 2;
-            while (pos < source.length() && source[pos] != '\n') pos++;
-            continue;
-        }
-        // Skip multi-line comments
-        if (source.substr(pos, 2) == "/*") {
-            pos += 2;
-            while (pos + 1 < source.length() && !(source[pos] == '*' && source[pos + 1] == '/')) {
-                if (source[pos] == '\n') {
-                    line++;
-                    lineStart = pos + 1;
+#include "scan.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// Character classes driving the scanner. Every byte of the source is
+// classified once through this table; the scanner then dispatches on the
+// class instead of trying each token pattern in turn.
+enum CharClass : unsigned char {
+    CC_OTHER,   // illegal character
+    CC_SPACE,   // ' ', \t, \v, \f, \r
+    CC_NEWLINE, // \n
+    CC_ALPHA,   // [a-zA-Z_]
+    CC_DIGIT,   // [0-9]
+    CC_HASH,    // '#'
+    CC_SLASH,   // '/'
+    CC_QUOTE,   // '"'
+    CC_EQUAL,   // '='
+    CC_BANG,    // '!'
+    CC_LESS,    // '<'
+    CC_GREATER, // '>'
+    CC_OP,      // + - * %
+    CC_PUNCT    // ( ) { } ; ,
+};
+
+static constexpr array<unsigned char, 256> makeCharClasses() {
+    array<unsigned char, 256> table{};
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = CC_ALPHA;
+    for (int c = 'A'; c <= 'Z'; ++c) table[c] = CC_ALPHA;
+    for (int c = '0'; c <= '9'; ++c) table[c] = CC_DIGIT;
+    table['_'] = CC_ALPHA;
+    table[' '] = table['\t'] = table['\v'] = table['\f'] = table['\r'] = CC_SPACE;
+    table['\n'] = CC_NEWLINE;
+    table['#'] = CC_HASH;
+    table['/'] = CC_SLASH;
+    table['"'] = CC_QUOTE;
+    table['='] = CC_EQUAL;
+    table['!'] = CC_BANG;
+    table['<'] = CC_LESS;
+    table['>'] = CC_GREATER;
+    table['+'] = table['-'] = table['*'] = table['%'] = CC_OP;
+    table['('] = table[')'] = table['{'] = table['}'] = table[';'] = table[','] = CC_PUNCT;
+    return table;
+}
+
+static constexpr array<unsigned char, 256> charClass = makeCharClasses();
+
+static TokenType punctType(char c) {
+    switch (c) {
+        case '(': return TokenType::LPAREN;
+        case ')': return TokenType::RPAREN;
+        case '{': return TokenType::LBRACE;
+        case '}': return TokenType::RBRACE;
+        case ';': return TokenType::SEMI;
+        default:  return TokenType::COMMA;
+    }
+}
+
+// Keywords are recognized after the identifier has been scanned, so an
+// identifier such as "integer" is a single ID rather than INT + "eger".
+static TokenType keywordType(const char* text, size_t length) {
+    switch (length) {
+        case 2: if (memcmp(text, "if", 2) == 0) return TokenType::IF; break;
+        case 3: if (memcmp(text, "int", 3) == 0) return TokenType::INT; break;
+        case 4: if (memcmp(text, "else", 4) == 0) return TokenType::ELSE; break;
+        case 6: if (memcmp(text, "return", 6) == 0) return TokenType::RETURN; break;
+    }
+    return TokenType::ID;
+}
+
+string_view TokenStream::value(size_t i) const {
+    if (types[i] == TokenType::STRING) {
+        // Strip quotes; an unterminated literal at end of input may lack the closing one
+        size_t length = lengths[i] >= 2 ? lengths[i] - 2 : 0;
+        return source.substr(offsets[i] + 1, length);
+    }
+    return source.substr(offsets[i], lengths[i]);
+}
+
+int TokenStream::column(size_t i) const {
+    if (types[i] == TokenType::END) return 0;
+    return static_cast<int>(offsets[i] - lineStart(line(i)));
+}
+
+Token TokenStream::token(size_t i) const {
+    return Token(types[i], string(value(i)), line(i), column(i));
+}
+
+void TokenStream::clear() {
+    types.clear();
+    offsets.clear();
+    lengths.clear();
+    lineStarts.clear();
+}
+
+void TokenStream::reserve(size_t count) {
+    types.reserve(count);
+    offsets.reserve(count);
+    lengths.reserve(count);
+}
+
+void TokenStream::push(TokenType type, size_t offset, size_t length) {
+    types.push_back(type);
+    offsets.push_back(static_cast<uint32_t>(offset));
+    lengths.push_back(static_cast<uint32_t>(length));
+}
+
+const vector<uint32_t>& TokenStream::lineTable() const {
+    if (lineStarts.empty()) {
+        lineStarts.push_back(0);
+        scanKernels().collectLineStarts(source.data(), source.data() + source.size(), lineStarts);
+    }
+    return lineStarts;
+}
+
+int TokenStream::lineOf(size_t offset) const {
+    const vector<uint32_t>& table = lineTable();
+    return static_cast<int>(upper_bound(table.begin(), table.end(), offset) - table.begin());
+}
+
+size_t TokenStream::lineStart(int line) const {
+    return lineTable()[line - 1];
+}
+
+static void reportIllegalCharacters(const TokenStream& tokens, const vector<uint32_t>& errorOffsets, vector<string>& errors) {
+    for (uint32_t pos : errorOffsets) {
+        int line = tokens.lineOf(pos);
+        errors.push_back("Illegal character '" + string(1, tokens.source[pos]) + "' at line " + to_string(line) + ", column " + to_string(pos - tokens.lineStart(line)));
+    }
+}
+
+// Position of the next '\n' at or after pos, or the end of input
+static size_t skipLine(const char* src, size_t pos, size_t length) {
+    const void* newline = pos < length ? memchr(src + pos, '\n', length - pos) : nullptr;
+    return newline ? static_cast<const char*>(newline) - src : length;
+}
+
+// Scans every item (token, comment, whitespace run, directive) that starts
+// in [pos, stop). The last item may run past stop; the return value is the
+// position where scanning would resume. Scanning keeps no state besides the
+// position, so two scans that reach the same position agree from there on.
+static size_t lexRange(string_view source, size_t pos, size_t stop, TokenStream& tokens, vector<uint32_t>& errorOffsets) {
+    const char* src = source.data();
+    const size_t length = source.length();
+    const ScanKernels& scan = scanKernels();
+    while (pos < stop) {
+        size_t start = pos;
+        char c = src[pos];
+        switch (charClass[static_cast<unsigned char>(c)]) {
+            case CC_SPACE:
+            case CC_NEWLINE:
+                pos = scan.skipSpace(src + pos + 1, src + stop) - src;
+                break;
+            case CC_HASH:
+                // Skip preprocessor directives
+                pos = skipLine(src, pos, length);
+                break;
+            case CC_SLASH:
+                if (pos + 1 < length && src[pos + 1] == '/') {
+                    // Skip single-line comments
+                    pos = skipLine(src, pos + 2, length);
+                } else if (pos + 1 < length && src[pos + 1] == '*') {
+                    // Skip multi-line comments; an unterminated one runs to end of input
+                    pos = scan.findCommentEnd(src + pos + 2, src + length) - src;
+                    pos = pos < length ? pos + 2 : length;
+                } else {
+                    pos++;
+                    tokens.push(TokenType::OP, start, 1);
                 }
+                break;
+            case CC_QUOTE:
+                // String literals
                 pos++;
-            }
-            if (pos + 1 < source.length()) pos += 2; // skip closing */
-            continue;
-        }
-        // String literals
-        if (source[pos] == '"') {
-            size_t start = pos;
-            pos++;
-            while (pos < source.length()) {
-                if (source[pos] == '\\' && pos + 1 < source.length()) {
-                    pos += 2; // skip escaped char
-                } else if (source[pos] == '"') {
-                    pos++;
-                    break;
-                } else {
-                    if (source[pos] == '\n') {
-                        line++;
-                        lineStart = pos + 1;
+                while ((pos = scan.findQuoteOrEscape(src + pos, src + length) - src) < length) {
+                    if (src[pos] == '"') {
+                        pos++;
+                        break;
                     }
+                    pos += pos + 1 < length ? 2 : 1; // skip escaped char
+                }
+                tokens.push(TokenType::STRING, start, pos - start);
+                break;
+            case CC_ALPHA:
+                pos++;
+                while (pos < length && charClass[static_cast<unsigned char>(src[pos])] >= CC_ALPHA
+                       && charClass[static_cast<unsigned char>(src[pos])] <= CC_DIGIT) pos++;
+                tokens.push(keywordType(src + start, pos - start), start, pos - start);
+                break;
+            case CC_DIGIT:
+                pos++;
+                while (pos < length && charClass[static_cast<unsigned char>(src[pos])] == CC_DIGIT) pos++;
+                tokens.push(TokenType::NUMBER, start, pos - start);
+                break;
+            case CC_EQUAL:
+            case CC_LESS:
+            case CC_GREATER:
+                // '=' alone is ASSIGN; '<' and '>' alone are COMPARE; any of them
+                // followed by '=' forms a two-character COMPARE
+                if (pos + 1 < length && src[pos + 1] == '=') {
+                    pos += 2;
+                    tokens.push(TokenType::COMPARE, start, 2);
+                } else {
                     pos++;
+                    tokens.push(c == '=' ? TokenType::ASSIGN : TokenType::COMPARE, start, 1);
                 }
-            }
-            // Strip quotes: extract content between quotes
-            string fullValue = source.substr(start, pos - start);
-            string cleanValue = fullValue.substr(1, fullValue.length() - 2); // Remove first and last char (quotes)
-            int column = start - lineStart;
-            tokens.emplace_back(TokenType::STRING, cleanValue, line, column);
-            continue;
-        }
-        bool matched = false;
-        for (size_t i = 0; i < tokenSpecs.size(); ++i) {
-            const string& pattern = tokenSpecs[i].first;
-            TokenType type = tokenSpecs[i].second;
-            regex re("^" + pattern);
-            smatch match;
-            string remaining = source.substr(pos);
-            if (regex_search(remaining, match, re)) {
-                string value = match.str();
-                int column = pos - lineStart;
-                tokens.emplace_back(type, value, line, column);
-                pos += value.length();
-                matched = true;
                 break;
-            }
+            case CC_BANG:
+                if (pos + 1 < length && src[pos + 1] == '=') {
+                    pos += 2;
+                    tokens.push(TokenType::COMPARE, start, 2);
+                    break;
+                }
+                errorOffsets.push_back(static_cast<uint32_t>(pos));
+                pos++;
+                break;
+            case CC_OP:
+                pos++;
+                tokens.push(TokenType::OP, start, 1);
+                break;
+            case CC_PUNCT:
+                pos++;
+                tokens.push(punctType(c), start, 1);
+                break;
+            default:
+                errorOffsets.push_back(static_cast<uint32_t>(pos));
+                pos++;
+                break;
+        }
+    }
+    return pos;
+}
+
+static bool checkSourceSize(string_view source, TokenStream& tokens, vector<string>& errors) {
+    if (source.length() <= UINT32_MAX) return true;
+    errors.push_back("Source file too large (limit is 4 GiB)");
+    tokens.push(TokenType::END, 0, 0);
+    return false;
+}
+
+void tokenize(string_view source, TokenStream& tokens, vector<string>& errors) {
+    tokens.clear();
+    tokens.source = source;
+    if (!checkSourceSize(source, tokens, errors)) return;
+    vector<uint32_t> errorOffsets;
+    lexRange(source, 0, source.length(), tokens, errorOffsets);
+    tokens.push(TokenType::END, source.length(), 0);
+    reportIllegalCharacters(tokens, errorOffsets, errors);
+}
+
+// Result of lexing one chunk speculatively, as if no comment or string
+// literal were open at its first byte.
+struct LexChunk {
+    size_t begin = 0;
+    size_t end = 0;
+    size_t resume = 0;
+    TokenStream tokens;
+    vector<uint32_t> errorOffsets;
+};
+
+// Appends chunk tokens [from, size) to the merged stream.
+static void appendChunk(TokenStream& merged, const TokenStream& chunk, size_t from) {
+    merged.types.insert(merged.types.end(), chunk.types.begin() + from, chunk.types.end());
+    merged.offsets.insert(merged.offsets.end(), chunk.offsets.begin() + from, chunk.offsets.end());
+    merged.lengths.insert(merged.lengths.end(), chunk.lengths.begin() + from, chunk.lengths.end());
+}
+
+// Below this much source per worker, splitting costs more than it saves.
+static const size_t minParallelChunk = 256 * 1024;
+
+void tokenizeParallel(string_view source, TokenStream& tokens, vector<string>& errors, unsigned threads) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads <= 1 || source.length() < 2 * minParallelChunk) {
+        tokenize(source, tokens, errors);
+        return;
+    }
+    tokens.clear();
+    tokens.source = source;
+    if (!checkSourceSize(source, tokens, errors)) return;
+
+    // Split into a few chunks per thread, each ending just after a newline
+    const size_t length = source.length();
+    size_t chunkSize = max(minParallelChunk, length / (threads * 4));
+    vector<LexChunk> chunks;
+    for (size_t begin = 0; begin < length;) {
+        size_t end = begin + chunkSize;
+        if (end >= length) {
+            end = length;
+        } else {
+            size_t newline = source.find('\n', end);
+            end = newline == string_view::npos ? length : newline + 1;
         }
-        if (!matched) {
-            int column = pos - lineStart;
-            errors.push_back("Illegal character '" + string(1, source[pos]) + "' at line " + to_string(line) + ", column " + to_string(column));
-            pos++;
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = end;
+        begin = end;
+    }
+
+    {
+        ThreadPool pool(min<size_t>(threads, chunks.size()));
+        for (auto& chunk : chunks) {
+            pool.submit([&source, &chunk] {
+                chunk.tokens.source = source;
+                chunk.tokens.reserve((chunk.end - chunk.begin) / 4);
+                chunk.resume = lexRange(source, chunk.begin, chunk.end, chunk.tokens, chunk.errorOffsets);
+            });
         }
+        pool.wait();
+    }
+
+    // Stitch the chunks together in order. A chunk whose start the previous
+    // chunk overran (an open comment or string literal) is re-lexed serially
+    // from the true resume point until it lands on one of the chunk's own
+    // token starts; from there the speculative result is valid.
+    size_t totalTokens = 0;
+    for (const auto& chunk : chunks) totalTokens += chunk.tokens.size();
+    tokens.reserve(totalTokens + 1);
+    vector<uint32_t> errorOffsets;
+    size_t pos = 0;
+    for (auto& chunk : chunks) {
+        const vector<uint32_t>& starts = chunk.tokens.offsets;
+        size_t next = lower_bound(starts.begin(), starts.end(), pos) - starts.begin();
+        while (pos > chunk.begin && pos < chunk.end && (next == starts.size() || starts[next] != pos)) {
+            size_t stop = next == starts.size() ? chunk.end : starts[next];
+            pos = lexRange(source, pos, stop, tokens, errorOffsets);
+            next = lower_bound(starts.begin() + next, starts.end(), pos) - starts.begin();
+        }
+        if (pos >= chunk.end) continue;
+        appendChunk(tokens, chunk.tokens, next);
+        for (uint32_t offset : chunk.errorOffsets) {
+            if (offset >= pos) errorOffsets.push_back(offset);
+        }
+        pos = chunk.resume;
+    }
+    tokens.push(TokenType::END, length, 0);
+    reportIllegalCharacters(tokens, errorOffsets, errors);
+}
+
+void tokenize(string_view source, vector<Token>& tokens, vector<string>& errors) {
+    TokenStream stream;
+    tokenize(source, stream, errors);
+    tokens.reserve(tokens.size() + stream.size());
+    for (size_t i = 0; i < stream.size(); ++i) {
+        tokens.push_back(stream.token(i));
     }
-    tokens.emplace_back(TokenType::END, "", line, 0);
-} 
\ No newline at end of file
+}
@@ -1,11 +1,13 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 using namespace std;
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     INT, RETURN, IF, ELSE,
     ID, NUMBER, STRING,
     OP, COMPARE, ASSIGN,
@@ -23,6 +25,39 @@ struct Token {
         : type(t), value(v), line(l), column(c) {}
 };
 
-void tokenize(const string& source, vector<Token>& tokens, vector<string>& errors);
+// Compact token stream over a borrowed source buffer. Tokens are stored as
+// parallel arrays (9 bytes per token) and their values are views into the
+// source, so the buffer must outlive the stream. Line numbers are resolved
+// on demand from a line-start table built on first use.
+struct TokenStream {
+    string_view source;
+    vector<TokenType> types;
+    vector<uint32_t> offsets;     // byte offset of the lexeme
+    vector<uint32_t> lengths;     // lexeme length, quotes included for STRING
 
-#endif // LEXER_HPP 
\ No newline at end of file
+    size_t size() const { return types.size(); }
+    TokenType type(size_t i) const { return types[i]; }
+    string_view value(size_t i) const;
+    int line(size_t i) const { return lineOf(offsets[i]); }
+    int column(size_t i) const;
+    Token token(size_t i) const;
+
+    void clear();
+    void reserve(size_t count);
+    void push(TokenType type, size_t offset, size_t length);
+    int lineOf(size_t offset) const;
+    size_t lineStart(int line) const;
+
+private:
+    mutable vector<uint32_t> lineStarts;
+    const vector<uint32_t>& lineTable() const;
+};
+
+void tokenize(string_view source, TokenStream& tokens, vector<string>& errors);
+void tokenize(string_view source, vector<Token>& tokens, vector<string>& errors);
+// Same result as tokenize(), with large sources lexed in newline-aligned
+// chunks on a pool of threads (0 = one per core). Small sources are lexed
+// serially.
+void tokenizeParallel(string_view source, TokenStream& tokens, vector<string>& errors, unsigned threads = 0);
+
+#endif // LEXER_HPP
@@ -1,112 +1,75 @@
 #include <iostream>
-#include <fstream>
-#include <vector>
 #include <string>
-#include <map>
-#include <memory>
+#include <vector>
 
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "semantic.hpp"
-#include "codegen.hpp"
+#include "source.hpp"
+#include "pipeline.hpp"
+#include "server.hpp"
+#include "batch.hpp"
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " <filename.c>" << endl;
-        return 1;
+    CompileOptions options;
+    vector<string> paths;
+    bool batch = false;
+    bool serveRequests = false;
+    const char* socketPath = nullptr;
+    bool badArguments = false;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (applyOption(arg, options)) continue;
+        if (arg == "-o" && i + 1 < argc) options.objectPath = argv[++i];
+        else if (arg == "--serve") serveRequests = true;
+        else if (arg.substr(0, 8) == "--serve=") {
+            serveRequests = true;
+            socketPath = argv[i] + 8;
+        } else if (arg == "--manifest" && i + 1 < argc) {
+            batch = true;
+            if (!readManifest(argv[++i], paths)) {
+                cerr << "Error: Could not read manifest '" << argv[i] << "'" << endl;
+                return 1;
+            }
+        } else if (arg[0] == '-') badArguments = true;
+        else paths.push_back(argv[i]);
     }
-    ifstream file(argv[1]);
-    if (!file.is_open()) {
-        cerr << "Error: Could not open file '" << argv[1] << "'" << endl;
-        return 1;
-    }
-    string sourceCode((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
-    file.close();
-    cout << "=== Source Code ===" << endl;
-    cout << sourceCode << endl << endl;
-
-    // Phase 1: Lexical Analysis
-    cout << "=== Lexical Analysis (Tokenization) ===" << endl;
-    vector<Token> tokens;
-    vector<string> errors;
-    tokenize(sourceCode, tokens, errors);
-    for (const auto& token : tokens) {
-        cout << "Line " << token.line << ", Column " << token.column << ": ";
-        switch (token.type) {
-            case TokenType::INT: cout << "Keyword (int)"; break;
-            case TokenType::RETURN: cout << "Keyword (return)"; break;
-            case TokenType::IF: cout << "Keyword (if)"; break;
-            case TokenType::ELSE: cout << "Keyword (else)"; break;
-            case TokenType::ID: cout << "ID"; break;
-            case TokenType::NUMBER: cout << "NUMBER"; break;
-            case TokenType::STRING: cout << "STRING"; break;
-            case TokenType::OP: cout << "OP"; break;
-            case TokenType::COMPARE: cout << "COMPARE"; break;
-            case TokenType::ASSIGN: cout << "ASSIGN"; break;
-            case TokenType::LPAREN: cout << "LPAREN"; break;
-            case TokenType::RPAREN: cout << "RPAREN"; break;
-            case TokenType::LBRACE: cout << "LBRACE"; break;
-            case TokenType::RBRACE: cout << "RBRACE"; break;
-            case TokenType::SEMI: cout << "SEMI"; break;
-            case TokenType::COMMA: cout << "COMMA"; break;
-            case TokenType::END: cout << "END"; break;
-        }
-        cout << " = " << token.value << endl;
+    // More than one source, or a manifest even if it lists just one
+    if (paths.size() > 1) batch = true;
+    string reason;
+    if (!checkOptions(options, reason)) {
+        cerr << "Error: " << reason << endl;
+        badArguments = true;
     }
-    if (!errors.empty()) {
-        cout << "\nCompilation errors:" << endl;
-        for (const auto& error : errors) {
-            cout << error << endl;
-        }
-        return 1;
+    // --run forks, and a child forked from the server's or a batch's
+    // worker threads could be left holding a lock, such as the
+    // allocator's, that another took
+    if ((serveRequests || batch) && options.run) {
+        cerr << "Error: --run is not available with " << (serveRequests ? "--serve" : "a batch")
+             << endl;
+        badArguments = true;
     }
-
-    // Phase 2: Syntax Analysis (Parsing)
-    cout << "\n=== Syntax Analysis (Parsing) ===" << endl;
-    size_t currentTokenIndex = 0;
-    shared_ptr<ASTNode> ast = parseProgram(tokens, currentTokenIndex, errors);
-    if (!errors.empty()) {
-        cout << "\nCompilation errors:" << endl;
-        for (const auto& error : errors) {
-            cout << error << endl;
-        }
+    // A server takes its sources from requests, and writes no files
+    if (serveRequests && (batch || !paths.empty() || options.objectPath)) badArguments = true;
+    // Each file of a batch gets a report; one object path cannot serve them all
+    if (batch && options.objectPath) badArguments = true;
+    if ((paths.empty() && !serveRequests && !batch) || badArguments) {
+        cerr << "Usage: " << argv[0] << " [-O] [-m64] [-o <object.o>] [--run | --interpret] [--emit=<phases>] <filename.c>"
+             << endl;
+        cerr << "       " << argv[0]
+             << " [-O] [-m64] [--interpret] [--emit=<phases>] [--manifest <file>] <filename.c>..." << endl;
+        cerr << "       " << argv[0] << " [-O] [-m64] [--interpret] [--emit=<phases>] --serve[=<socket path>]"
+             << endl;
+        cerr << "Phases: a comma-separated list of tokens, ast, tac and asm" << endl;
         return 1;
     }
-    cout << "\nParse Tree (JSON):" << endl;
-    if (ast) ast->printJSON(cout, 0);
-    cout << endl;
+    if (serveRequests) return serve(socketPath, options);
+    if (batch) return compileBatch(paths, options);
 
-    // Phase 3: Semantic Analysis
-    cout << "\n=== Semantic Analysis ===" << endl;
-    map<string, string> symbolTable;
-    semanticAnalysis(ast.get(), symbolTable, errors);
-    if (!errors.empty()) {
-        cout << "\nCompilation errors:" << endl;
-        for (const auto& error : errors) {
-            cout << error << endl;
-        }
+    const string& path = paths[0];
+    SourceFile source;
+    if (!source.open(path)) {
+        cerr << "Error: Could not open file '" << path << "'" << endl;
         return 1;
     }
-    cout << "Semantic analysis passed!" << endl;
-
-    // Phase 4: Intermediate Code Generation
-    cout << "\n=== Intermediate Code Generation ===" << endl;
-    vector<string> intermediateCode;
-    generateIntermediateCode(ast.get(), intermediateCode);
-    cout << "\nIntermediate Code (Three-Address Code):" << endl;
-    for (size_t i = 0; i < intermediateCode.size(); ++i) {
-        cout << i << ": " << intermediateCode[i] << endl;
-    }
-
-    // Phase 5: Assembly Code Generation
-    cout << "\n=== Assembly Code Generation ===" << endl;
-    vector<string> asmCode;
-    generateAssembly(ast.get(), asmCode);
-    cout << "\nAssembly Code:" << endl;
-    for (size_t i = 0; i < asmCode.size(); ++i) {
-        cout << i << ": " << asmCode[i] << endl;
-    }
-    return 0;
-} 
\ No newline at end of file
+    return compile(source.text(), options, cout);
+}
@@ -0,0 +1,24 @@
+#include "optimizer.hpp"
+#include "ssa.hpp"
+
+void optimize(IRModule& module, OptimizationReport& report) {
+    size_t unreachable = 0, constants = 0, redundant = 0, dead = 0, deadStores = 0;
+    for (IRFunction& function : module.functions) {
+        report.instructionsBefore += function.code.size();
+        ControlFlowGraph cfg;
+        buildCFG(function, cfg);
+        unreachable += removeUnreachableBlocks(cfg);
+        constructSSA(module, cfg);
+        constants += propagateConstants(module, function, cfg);
+        redundant += numberValues(module, function, cfg);
+        dead += eliminateDeadCode(module, function, cfg, deadStores);
+        destructSSA(function, cfg);
+        flattenCFG(cfg, function);
+        report.instructionsAfter += function.code.size();
+    }
+    report.passes.push_back({"Unreachable code", unreachable});
+    report.passes.push_back({"Constant propagation", constants});
+    report.passes.push_back({"Common subexpressions", redundant});
+    report.passes.push_back({"Dead temporaries", dead - deadStores});
+    report.passes.push_back({"Dead stores", deadStores});
+}
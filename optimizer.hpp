@@ -0,0 +1,41 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cfg.hpp"
+#include "ir.hpp"
+using namespace std;
+
+struct OptimizationReport {
+    size_t instructionsBefore = 0;
+    size_t instructionsAfter = 0;
+    vector<pair<string, size_t>> passes; // instructions eliminated by each pass
+};
+
+// Passes over one function in SSA form. Each returns the number of quads
+// it removed.
+
+// Sparse conditional constant propagation (Wegman and Zadeck): folds
+// constant expressions, substitutes known values for their uses and drops
+// branches that can never be taken
+size_t propagateConstants(const IRModule& module, IRFunction& function, ControlFlowGraph& cfg);
+
+// Dominator-based value numbering: an expression already computed in a
+// dominating block is reused instead of recomputed, and copies of
+// temporaries and constants are looked through
+size_t numberValues(const IRModule& module, IRFunction& function, ControlFlowGraph& cfg);
+
+// Mark-and-sweep dead code elimination: instructions with an effect
+// (calls, returns, branches) are live, as is everything they transitively
+// read; the rest is deleted. deadStores counts the deleted assignments to
+// variables.
+size_t eliminateDeadCode(const IRModule& module, IRFunction& function, ControlFlowGraph& cfg, size_t& deadStores);
+
+// Takes every function through SSA form, runs the passes above and writes
+// the result back as linear code
+void optimize(IRModule& module, OptimizationReport& report);
+
+#endif // OPTIMIZER_HPP
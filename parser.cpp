@@ -1,297 +1,312 @@
 #include "parser.hpp"
 #include "lexer.hpp"
+#include "ir.hpp"
+#include "json.hpp"
 #include <iostream>
 #include <algorithm>
 
+const char* nodeKindName(NodeKind kind) {
+    switch (kind) {
+        case NodeKind::Program: return "Program";
+        case NodeKind::FunctionDecl: return "FunctionDecl";
+        case NodeKind::Block: return "Block";
+        case NodeKind::Declaration: return "Declaration";
+        case NodeKind::Assignment: return "Assignment";
+        case NodeKind::IfElse: return "IfElse";
+        case NodeKind::Return: return "Return";
+        case NodeKind::FunctionCall: return "FunctionCall";
+        case NodeKind::BinaryExpr: return "BinaryExpr";
+        case NodeKind::Identifier: return "Identifier";
+        case NodeKind::NumberLiteral: return "NumberLiteral";
+        case NodeKind::StringLiteral: return "StringLiteral";
+    }
+    return "Unknown";
+}
+
 // Implement ASTNode print and printJSON methods here 
-void ASTNode::print() const {
-    cout << string(indentLevel * 2, ' ') << "└─ " << nodeType;
-    if (!value.empty()) cout << " (" << value << ")";
-    cout << endl;
-    for (const auto& child : children) {
-        child->print();
+// Every tree walk below keeps its own explicit stack, so deeply nested
+// input cannot overflow the call stack.
+void ASTNode::print(int depth) const {
+    // Pre-order: visiting a node pushes its next sibling, then its first
+    // child, so the child's whole subtree is printed before the sibling.
+    vector<pair<const ASTNode*, int>> stack = {{this, depth}};
+    while (!stack.empty()) {
+        auto [node, level] = stack.back();
+        stack.pop_back();
+        cout << string(level * 2, ' ') << "└─ " << nodeKindName(node->kind);
+        if (!node->value.empty()) cout << " (" << node->value << ")";
+        cout << endl;
+        if (node != this && node->next) stack.push_back({node->next, level});
+        if (node->firstChild) stack.push_back({node->firstChild, level + 1});
     }
 }
+// Indentation stops growing past this many columns so that output for very
+// deep trees stays linear in the number of nodes
+static const int maxJsonIndent = 256;
+
 void ASTNode::printJSON(ostream& out, int indent) const {
-    string ind(indent, ' ');
-    out << ind << "{\n";
-    out << ind << "  \"type\": \"" << nodeType << "\"";
-    if (!value.empty()) out << ",\n" << ind << "  \"value\": \"" << value << "\"";
-    if (!children.empty()) {
-        out << ",\n" << ind << "  \"children\": [\n";
-        for (size_t i = 0; i < children.size(); ++i) {
-            children[i]->printJSON(out, indent + 4);
-            if (i + 1 < children.size()) out << ",\n";
-        }
-        out << "\n" << ind << "  ]";
+    struct Frame {
+        const ASTNode* node;
+        const ASTNode* nextChild;
+        int indent;
+    };
+    vector<Frame> stack;
+    auto open = [&](const ASTNode* node, int nodeIndent) {
+        string ind(nodeIndent, ' ');
+        out << ind << "{\n";
+        out << ind << "  \"type\": \"" << nodeKindName(node->kind) << "\"";
+        if (!node->value.empty()) out << ",\n" << ind << "  \"value\": \"" << node->value << "\"";
+        if (node->firstChild) out << ",\n" << ind << "  \"children\": [\n";
+        stack.push_back({node, node->firstChild, nodeIndent});
+    };
+    open(this, indent);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (const ASTNode* child = frame.nextChild) {
+            if (child != frame.node->firstChild) out << ",\n";
+            frame.nextChild = child->next;
+            open(child, min(frame.indent + 4, maxJsonIndent));
+            continue;
+        }
+        string ind(frame.indent, ' ');
+        if (frame.node->firstChild) out << "\n" << ind << "  ]";
+        out << "\n" << ind << "}";
+        stack.pop_back();
     }
-    out << "\n" << ind << "}";
 }
-string ASTNode::generateIntermediateCode(vector<string>& code, int& tempCount) {
-    if (nodeType == "Program") {
-        for (const auto& child : children) {
-            child->generateIntermediateCode(code, tempCount);
-        }
-    } else if (nodeType == "FunctionDecl") {
-         code.push_back("func " + value);
-         for (const auto& child : children) {
-             child->generateIntermediateCode(code, tempCount);
-         }
-         code.push_back("endfunc");
-    } else if (nodeType == "Block") {
-        for (const auto& child : children) {
-            child->generateIntermediateCode(code, tempCount);
-        }
-    } else if (nodeType == "Declaration") {
-        if (!children.empty()) {
-            string temp = children[0]->generateIntermediateCode(code, tempCount);
-            code.push_back(value + " = " + temp);
-        } else {
-            code.push_back(value + " = 0");
-        }
-    } else if (nodeType == "Assignment") {
-        if (!children.empty()) {
-            string temp = children[0]->generateIntermediateCode(code, tempCount);
-            code.push_back(value + " = " + temp);
-        }
-    } else if (nodeType == "BinaryExpr") {
-        string leftTemp = children[0]->generateIntermediateCode(code, tempCount);
-        string rightTemp = children[1]->generateIntermediateCode(code, tempCount);
-        string resultTemp = "T" + to_string(++tempCount);
-        code.push_back(resultTemp + " = " + leftTemp + " " + value + " " + rightTemp);
-        return resultTemp;
-    } else if (nodeType == "Identifier") {
-        return value;
-    } else if (nodeType == "NumberLiteral") {
-        return value;
-    } else if (nodeType == "StringLiteral") {
-        return "\"" + value + "\"";
-    } else if (nodeType == "FunctionCall") {
-        // Generate param instructions for each argument
-        for (const auto& child : children) {
-            string arg = child->generateIntermediateCode(code, tempCount);
-            code.push_back("param " + arg);
-        }
-        string resultTemp = "T" + to_string(++tempCount);
-        code.push_back(resultTemp + " = call " + value + ", " + to_string(children.size()));
-        return resultTemp;
-    } else if (nodeType == "FunctionCallStatement") {
-        string args;
-        for (size_t i = 0; i < children.size(); ++i) {
-            if (i > 0) args += ", ";
-            args += children[i]->generateIntermediateCode(code, tempCount);
-        }
-        string resultTemp = "T" + to_string(++tempCount);
-        code.push_back(resultTemp + " = call " + value + ", " + to_string(children.size()));
-        return resultTemp;
-    } else if (nodeType == "Return") {
-        if (!children.empty()) {
-            string retVal = children[0]->generateIntermediateCode(code, tempCount);
-            code.push_back("return " + retVal);
-        }
-    } else if (nodeType == "IfElse") {
-        string cond = children[0]->generateIntermediateCode(code, tempCount);
-        string labelElse = "L" + to_string(++tempCount);
-        string labelEnd = "L" + to_string(++tempCount);
-        code.push_back("ifnot " + cond + " goto " + labelElse);
-        children[1]->generateIntermediateCode(code, tempCount);
-        code.push_back("goto " + labelEnd);
-        code.push_back(labelElse + ":");
-        if (children.size() > 2) {
-            children[2]->generateIntermediateCode(code, tempCount);
-        }
-        code.push_back(labelEnd + ":");
+
+void ASTNode::writeJSON(JsonWriter& json) const {
+    struct Frame {
+        const ASTNode* node;
+        const ASTNode* nextChild;
+    };
+    vector<Frame> stack;
+    auto open = [&](const ASTNode* node) {
+        json.beginObject();
+        json.key("type");
+        json.value(nodeKindName(node->kind));
+        if (!node->value.empty()) {
+            json.key("value");
+            json.value(node->value);
+        }
+        if (!node->firstChild) {
+            json.endObject();
+            return;
+        }
+        json.key("children");
+        json.beginArray();
+        stack.push_back({node, node->firstChild});
+    };
+    open(this);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (const ASTNode* child = frame.nextChild) {
+            frame.nextChild = child->next;
+            open(child);
+            continue;
+        }
+        json.endArray();
+        json.endObject();
+        stack.pop_back();
     }
-    return "";
 }
 
-string ASTNode::getRegister(int idx) const {
-    static vector<string> regs = {"eax", "ebx", "ecx", "edx", "esi", "edi"};
-    return regs[idx % regs.size()];
-}
+// Post-order walk state for IR lowering: a frame per statement or operator
+// node, tracking the next child to visit and how many children have been
+// completed. A binary operator whose right operand needs more registers
+// evaluates it first (Sethi-Ullman order); expressions have no side
+// effects, so only register pressure changes.
+struct WalkFrame {
+    const ASTNode* node;
+    const ASTNode* nextChild;
+    uint32_t visited;
+    bool rightFirst;
+    Operand labelElse;
+    Operand labelEnd;
+};
 
-string ASTNode::generateAssembly(vector<string>& asmCode, vector<pair<string, string>>& stringLiterals, int& regCount, const string& currentFunc) const {
-    if (nodeType == "NumberLiteral") {
-        return value; // Return immediate value
-    }
-    if (nodeType == "Identifier") {
-         // Should load variable value into a register for operation? 
-         // For minimalism, assuming stack based variables or direct memory (requires formatting like [var])
-         // But here we'll just return the identifier assuming the assembler handles 'mov eax, var'
-         return "[" + value + "]";
-    }
-    if (nodeType == "StringLiteral") {
-        string label = "LC" + to_string(stringLiterals.size());
-        stringLiterals.push_back({label, value});
-        return label;  // NASM syntax: just the label name
-    }
+static Opcode binaryOpcode(string_view op) {
+    if (op == "+") return Opcode::Add;
+    if (op == "-") return Opcode::Sub;
+    if (op == "*") return Opcode::Mul;
+    if (op == "/") return Opcode::Div;
+    if (op == "%") return Opcode::Mod;
+    if (op == "==") return Opcode::CmpEq;
+    if (op == "!=") return Opcode::CmpNe;
+    if (op == "<") return Opcode::CmpLt;
+    if (op == "<=") return Opcode::CmpLe;
+    if (op == ">") return Opcode::CmpGt;
+    return Opcode::CmpGe;
+}
 
-    if (nodeType == "BinaryExpr") {
-        // Simple register allocator: always use eax for result
-        string leftOp = children[0]->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
-        // If leftOp is not a register (e.g. memory or immediate), move it to eax
-        asmCode.push_back("mov eax, " + leftOp);
-        
-        // We need to save eax if we evaluate right side? 
-        // Simple compiler: push eax
-        asmCode.push_back("push eax");
-        
-        string rightOp = children[1]->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
-        
-        asmCode.push_back("mov ebx, " + rightOp); // right operand in ebx
-        asmCode.push_back("pop eax"); // left operand back in eax
-        
-        if (value == "+") {
-            asmCode.push_back("add eax, ebx");
-        } else if (value == "-") {
-            asmCode.push_back("sub eax, ebx");
-        } else if (value == "*") {
-            asmCode.push_back("imul eax, ebx");
-        } else if (value == "/") {
-            asmCode.push_back("cdq");
-            asmCode.push_back("idiv ebx");
-        }
-        return "eax";
-    }
+// Literals wrap modulo 2^32 like an int conversion would
+static int32_t numberValue(string_view digits) {
+    uint32_t value = 0;
+    for (char c : digits) value = value * 10 + static_cast<uint32_t>(c - '0');
+    return static_cast<int32_t>(value);
+}
 
-    if (nodeType == "Declaration" || nodeType == "Assignment") {
-        if (!children.empty()) {
-            string dim = children[0]->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
-            // Result is in dim (likely eax if expression, or immediate)
-             if (dim != "eax") {
-                 asmCode.push_back("mov eax, " + dim);
-             }
-            // Assume variables are global or static for simplicity in this toy compiler
-            asmCode.push_back("mov [" + value + "], eax");
-        } else {
-            asmCode.push_back("mov dword [" + value + "], 0");
+void ASTNode::generateIntermediateCode(IRModule& module) const {
+    vector<WalkFrame> stack;
+    vector<Operand> values; // results of completed expression nodes
+    IRFunction* function = nullptr;
+    auto pop = [&]() {
+        Operand value = values.back();
+        values.pop_back();
+        return value;
+    };
+    // Leaves produce their value at once; other nodes get a frame
+    auto enter = [&](const ASTNode* node) {
+        switch (node->kind) {
+        case NodeKind::Identifier:
+            values.push_back(Operand::var(module.internVar(node->value)));
+            return false;
+        case NodeKind::NumberLiteral:
+            values.push_back(Operand::constant(numberValue(node->value)));
+            return false;
+        case NodeKind::StringLiteral:
+            values.push_back(Operand::string(module.addString(node->value)));
+            return false;
+        case NodeKind::FunctionDecl:
+            module.functions.emplace_back();
+            function = &module.functions.back();
+            function->name = node->value;
+            break;
+        default:
+            break;
         }
-        return "";
-    }
-
-    if (nodeType == "FunctionCall") {
-        // Cdecl convention: push args in reverse order
-        size_t argCount = children.size();
-        for (int i = argCount - 1; i >= 0; --i) {
-            string arg = children[i]->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
-            if (arg != "eax") {
-                 asmCode.push_back("mov eax, " + arg);
+        bool rightFirst = node->kind == NodeKind::BinaryExpr && node->lastChild->registers > node->firstChild->registers;
+        stack.push_back({node, rightFirst ? node->lastChild : node->firstChild, 0, rightFirst, {}, {}});
+        return true;
+    };
+    auto afterChild = [&](WalkFrame& frame) {
+        uint32_t index = frame.visited++;
+        switch (frame.node->kind) {
+        case NodeKind::Program:
+        case NodeKind::Block:
+            // A call used as a statement leaves its unused result behind
+            values.clear();
+            break;
+        case NodeKind::FunctionCall:
+            // Generate param instructions for each argument
+            function->emit(Opcode::Param, {}, pop());
+            break;
+        case NodeKind::IfElse:
+            // Without an else block the false branch goes straight to the end
+            if (index == 0) {
+                frame.labelElse = function->newLabel();
+                frame.labelEnd = frame.node->childCount > 2 ? function->newLabel() : frame.labelElse;
+                function->emit(Opcode::IfNot, {}, pop(), frame.labelElse);
+            } else if (index == 1 && frame.node->childCount > 2) {
+                function->emit(Opcode::Goto, {}, frame.labelEnd);
+                function->placeLabel(frame.labelElse);
             }
-            asmCode.push_back("push eax");
-        }
-        string funcName = value;
-        if (funcName == "printf") funcName = "_printf"; // decorate for Windows
-        asmCode.push_back("call " + funcName);
-        if (argCount > 0) {
-            asmCode.push_back("add esp, " + to_string(argCount * 4));
+            break;
+        default:
+            break;
         }
-        return "eax"; // Result in eax
-    }
-
-    if (nodeType == "Program") {
-        for (const auto& child : children) {
-            child->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
+    };
+    auto leave = [&](WalkFrame& frame) {
+        const ASTNode* node = frame.node;
+        switch (node->kind) {
+        case NodeKind::FunctionDecl:
+            function = nullptr;
+            break;
+        case NodeKind::Declaration:
+            function->emit(Opcode::Copy, Operand::var(module.internVar(node->value)),
+                           node->firstChild ? pop() : Operand::constant(0));
+            break;
+        case NodeKind::Assignment:
+            if (node->firstChild) function->emit(Opcode::Copy, Operand::var(module.internVar(node->value)), pop());
+            break;
+        case NodeKind::BinaryExpr: {
+            Operand right = pop();
+            Operand left = pop();
+            if (frame.rightFirst) swap(left, right);
+            Operand result = function->newTemp();
+            function->emit(binaryOpcode(node->value), result, left, right);
+            values.push_back(result);
+            break;
         }
-        return "";
-    }
-
-    if (nodeType == "FunctionDecl") {
-        // Prologue
-        string funcName = value;
-        if (funcName == "main") funcName = "_main";
-        
-        asmCode.push_back(funcName + ":");
-        asmCode.push_back("push ebp");
-        asmCode.push_back("mov ebp, esp");
-        
-        // Create exit label name
-        string exitLabel = ".Lexit_" + funcName;
-        
-        for (const auto& child : children) {
-            child->generateAssembly(asmCode, stringLiterals, regCount, funcName);
+        case NodeKind::FunctionCall: {
+            Operand result = function->newTemp();
+            function->emit(Opcode::Call, result, Operand::symbol(module.internSymbol(node->value)),
+                           Operand::constant(node->childCount));
+            values.push_back(result);
+            break;
         }
-        
-        // Epilogue (in case no return stmt) acts as target for jumps
-        asmCode.push_back(exitLabel + ":");
-        asmCode.push_back("mov esp, ebp");
-        asmCode.push_back("pop ebp");
-        asmCode.push_back("ret");
-        return "";
-    }
-    
-    if (nodeType == "Block") {
-         for (const auto& child : children) {
-            child->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
+        case NodeKind::Return:
+            function->emit(Opcode::Return, {}, node->firstChild ? pop() : Operand{});
+            break;
+        case NodeKind::IfElse:
+            function->placeLabel(frame.labelEnd);
+            break;
+        default:
+            break;
         }
-        return "";
-    }
+    };
 
-    if (nodeType == "Return") {
-        if (!children.empty()) {
-            string retVal = children[0]->generateAssembly(asmCode, stringLiterals, regCount, currentFunc);
-            if (retVal != "eax") {
-                asmCode.push_back("mov eax, " + retVal);
-            }
-        }
-        // Jump to shared epilogue
-        string funcName = currentFunc;
-        if (funcName == "main") funcName = "_main";
-        string exitLabel = ".Lexit_" + funcName;
-        asmCode.push_back("jmp " + exitLabel);
-        return "";
+    enter(this);
+    while (!stack.empty()) {
+        WalkFrame& frame = stack.back();
+        if (const ASTNode* child = frame.nextChild) {
+            if (!frame.rightFirst) frame.nextChild = child->next;
+            else frame.nextChild = child == frame.node->lastChild ? frame.node->firstChild : nullptr;
+            if (!enter(child)) afterChild(stack.back());
+            continue;
+        }
+        leave(frame);
+        stack.pop_back();
+        if (!stack.empty()) afterChild(stack.back());
     }
-
-    return "";
 }
 
 // --- Parser implementation for minimal C with function call support ---
 
 // Forward declarations
-shared_ptr<ASTNode> parseStatement(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors);
-shared_ptr<ASTNode> parseExpression(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors, int minPrec = 0);
-shared_ptr<ASTNode> parseFunctionCall(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors);
+ASTNode* parseStatement(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors);
+void parseStatements(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors, ASTNode* body);
+ASTNode* parseExpression(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors);
+ASTNode* parseFunctionCall(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors);
 
-shared_ptr<ASTNode> parseProgram(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors) {
-    auto program = make_shared<ASTNode>("Program");
+ASTNode* parseProgram(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors) {
+    auto program = arena.make<ASTNode>(NodeKind::Program);
     
     // Expect: int main() { ... }
-    if (tokens[currentTokenIndex].type != TokenType::INT) {
+    if (tokens.type(currentTokenIndex) != TokenType::INT) {
         errors.push_back("Expected 'int' at start of program");
         return nullptr;
     }
     currentTokenIndex++; // skip 'int'
-    if (tokens[currentTokenIndex].type != TokenType::ID || tokens[currentTokenIndex].value != "main") {
+    if (tokens.type(currentTokenIndex) != TokenType::ID || tokens.value(currentTokenIndex) != "main") {
         errors.push_back("Expected 'main' after 'int'");
         return nullptr;
     }
-    string funcName = tokens[currentTokenIndex].value;
+    string_view funcName = tokens.value(currentTokenIndex);
     currentTokenIndex++; // skip 'main'
     
-    auto funcDecl = make_shared<ASTNode>("FunctionDecl", funcName);
+    auto funcDecl = arena.make<ASTNode>(NodeKind::FunctionDecl, funcName);
     
-    if (tokens[currentTokenIndex].type != TokenType::LPAREN) {
+    if (tokens.type(currentTokenIndex) != TokenType::LPAREN) {
         errors.push_back("Expected '(' after 'main'");
         return nullptr;
     }
     currentTokenIndex++; // skip '('
-    if (tokens[currentTokenIndex].type != TokenType::RPAREN) {
+    if (tokens.type(currentTokenIndex) != TokenType::RPAREN) {
         errors.push_back("Expected ')' after '(' in main");
         return nullptr;
     }
     currentTokenIndex++; // skip ')'
-    if (tokens[currentTokenIndex].type != TokenType::LBRACE) {
+    if (tokens.type(currentTokenIndex) != TokenType::LBRACE) {
         errors.push_back("Expected '{' at start of main body");
         return nullptr;
     }
     currentTokenIndex++; // skip '{'
     
-    auto block = make_shared<ASTNode>("Block");
+    auto block = arena.make<ASTNode>(NodeKind::Block);
     
-    while (tokens[currentTokenIndex].type != TokenType::RBRACE && tokens[currentTokenIndex].type != TokenType::END) {
-        auto stmt = parseStatement(tokens, currentTokenIndex, errors);
-        if (stmt) block->addChild(stmt);
-    }
-    if (tokens[currentTokenIndex].type != TokenType::RBRACE) {
+    parseStatements(tokens, currentTokenIndex, arena, errors, block);
+    if (tokens.type(currentTokenIndex) != TokenType::RBRACE) {
         errors.push_back("Expected '}' at end of main body");
         return nullptr;
     }
@@ -303,172 +318,198 @@ shared_ptr<ASTNode> parseProgram(const vector<Token>& tokens, size_t& currentTok
     return program;
 }
 
-shared_ptr<ASTNode> parseStatement(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors) {
-    if (tokens[currentTokenIndex].type == TokenType::INT) {
+ASTNode* parseStatement(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors) {
+    if (tokens.type(currentTokenIndex) == TokenType::INT) {
         // Declaration
         currentTokenIndex++; // skip 'int'
-        if (tokens[currentTokenIndex].type != TokenType::ID) {
+        if (tokens.type(currentTokenIndex) != TokenType::ID) {
             errors.push_back("Expected identifier after 'int'");
             return nullptr;
         }
-        string varName = tokens[currentTokenIndex].value;
+        string_view varName = tokens.value(currentTokenIndex);
         currentTokenIndex++; // skip ID
-        shared_ptr<ASTNode> expr = nullptr;
-        if (tokens[currentTokenIndex].type == TokenType::ASSIGN) {
+        ASTNode* expr = nullptr;
+        if (tokens.type(currentTokenIndex) == TokenType::ASSIGN) {
             currentTokenIndex++; // skip '='
-            expr = parseExpression(tokens, currentTokenIndex, errors);
+            expr = parseExpression(tokens, currentTokenIndex, arena, errors);
             if (!expr) {
                 errors.push_back("Invalid expression in declaration");
                 return nullptr;
             }
         }
-        if (tokens[currentTokenIndex].type != TokenType::SEMI) {
+        if (tokens.type(currentTokenIndex) != TokenType::SEMI) {
             errors.push_back("Expected ';' at end of declaration");
             return nullptr;
         }
         currentTokenIndex++; // skip ';'
-        auto decl = make_shared<ASTNode>("Declaration", varName);
+        auto decl = arena.make<ASTNode>(NodeKind::Declaration, varName);
         if (expr) decl->addChild(expr);
         return decl;
-    } else if (tokens[currentTokenIndex].type == TokenType::ID) {
+    } else if (tokens.type(currentTokenIndex) == TokenType::ID) {
         // Assignment or function call
         size_t lookahead = currentTokenIndex + 1;
-        if (tokens[lookahead].type == TokenType::ASSIGN) {
+        if (tokens.type(lookahead) == TokenType::ASSIGN) {
             // Assignment
-            string varName = tokens[currentTokenIndex].value;
+            string_view varName = tokens.value(currentTokenIndex);
             currentTokenIndex += 2; // skip ID and '='
-            auto expr = parseExpression(tokens, currentTokenIndex, errors);
+            auto expr = parseExpression(tokens, currentTokenIndex, arena, errors);
             if (!expr) {
                 errors.push_back("Invalid expression in assignment");
                 return nullptr;
             }
-            if (tokens[currentTokenIndex].type != TokenType::SEMI) {
+            if (tokens.type(currentTokenIndex) != TokenType::SEMI) {
                 errors.push_back("Expected ';' at end of assignment");
                 return nullptr;
             }
             currentTokenIndex++; // skip ';'
-            auto assign = make_shared<ASTNode>("Assignment", varName);
+            auto assign = arena.make<ASTNode>(NodeKind::Assignment, varName);
             assign->addChild(expr);
             return assign;
-        } else if (tokens[lookahead].type == TokenType::LPAREN) {
+        } else if (tokens.type(lookahead) == TokenType::LPAREN) {
             // Function call
-            return parseFunctionCall(tokens, currentTokenIndex, errors);
+            return parseFunctionCall(tokens, currentTokenIndex, arena, errors);
         } else {
-            errors.push_back("Unexpected statement or keyword '" + tokens[currentTokenIndex].value + "' at line " + std::to_string(tokens[currentTokenIndex].line) + ", column " + std::to_string(tokens[currentTokenIndex].column));
+            errors.push_back("Unexpected statement or keyword '" + string(tokens.value(currentTokenIndex)) + "' at line " + std::to_string(tokens.line(currentTokenIndex)) + ", column " + std::to_string(tokens.column(currentTokenIndex)));
             currentTokenIndex++;
             return nullptr;
         }
-    } else if (tokens[currentTokenIndex].type == TokenType::IF) {
-        // If/else
-        currentTokenIndex++; // skip 'if'
-        if (tokens[currentTokenIndex].type != TokenType::LPAREN) {
-            errors.push_back("Expected '(' after 'if'");
-            return nullptr;
-        }
-        currentTokenIndex++; // skip '('
-        auto condition = parseExpression(tokens, currentTokenIndex, errors);
-        if (!condition) {
-            errors.push_back("Invalid condition in if statement");
-            return nullptr;
-        }
-        if (tokens[currentTokenIndex].type != TokenType::RPAREN) {
-            errors.push_back("Expected ')' after if condition");
-            return nullptr;
-        }
-        currentTokenIndex++; // skip ')'
-        if (tokens[currentTokenIndex].type != TokenType::LBRACE) {
-            errors.push_back("Expected '{' after if condition");
-            return nullptr;
-        }
-        currentTokenIndex++; // skip '{'
-        auto ifBlock = make_shared<ASTNode>("Block");
-        while (tokens[currentTokenIndex].type != TokenType::RBRACE && tokens[currentTokenIndex].type != TokenType::END) {
-            auto stmt = parseStatement(tokens, currentTokenIndex, errors);
-            if (stmt) ifBlock->addChild(stmt);
-        }
-        if (tokens[currentTokenIndex].type != TokenType::RBRACE) {
-            errors.push_back("Expected '}' at end of if block");
-            return nullptr;
-        }
-        currentTokenIndex++; // skip '}'
-        shared_ptr<ASTNode> elseBlock = nullptr;
-        if (tokens[currentTokenIndex].type == TokenType::ELSE) {
-            currentTokenIndex++; // skip 'else'
-            if (tokens[currentTokenIndex].type != TokenType::LBRACE) {
-                errors.push_back("Expected '{' after 'else'");
-                return nullptr;
-            }
-            currentTokenIndex++; // skip '{'
-            elseBlock = make_shared<ASTNode>("Block");
-            while (tokens[currentTokenIndex].type != TokenType::RBRACE && tokens[currentTokenIndex].type != TokenType::END) {
-                auto stmt = parseStatement(tokens, currentTokenIndex, errors);
-                if (stmt) elseBlock->addChild(stmt);
-            }
-            if (tokens[currentTokenIndex].type != TokenType::RBRACE) {
-                errors.push_back("Expected '}' at end of else block");
-                return nullptr;
-            }
-            currentTokenIndex++; // skip '}'
-        }
-        auto ifElseNode = make_shared<ASTNode>("IfElse");
-        ifElseNode->addChild(condition);
-        ifElseNode->addChild(ifBlock);
-        if (elseBlock) ifElseNode->addChild(elseBlock);
-        return ifElseNode;
-    } else if (tokens[currentTokenIndex].type == TokenType::RETURN) {
+    } else if (tokens.type(currentTokenIndex) == TokenType::RETURN) {
         // Return
         currentTokenIndex++; // skip 'return'
-        auto expr = parseExpression(tokens, currentTokenIndex, errors);
+        auto expr = parseExpression(tokens, currentTokenIndex, arena, errors);
         if (!expr) {
             errors.push_back("Invalid expression in return statement");
             return nullptr;
         }
-        if (tokens[currentTokenIndex].type != TokenType::SEMI) {
+        if (tokens.type(currentTokenIndex) != TokenType::SEMI) {
             errors.push_back("Expected ';' after return statement");
             return nullptr;
         }
         currentTokenIndex++; // skip ';'
-        auto retNode = make_shared<ASTNode>("Return");
+        auto retNode = arena.make<ASTNode>(NodeKind::Return);
         retNode->addChild(expr);
         return retNode;
     } else {
-        errors.push_back("Unexpected statement or keyword '" + tokens[currentTokenIndex].value + "' at line " + std::to_string(tokens[currentTokenIndex].line) + ", column " + std::to_string(tokens[currentTokenIndex].column));
+        errors.push_back("Unexpected statement or keyword '" + string(tokens.value(currentTokenIndex)) + "' at line " + std::to_string(tokens.line(currentTokenIndex)) + ", column " + std::to_string(tokens.column(currentTokenIndex)));
         currentTokenIndex++;
         return nullptr;
     }
 }
 
-shared_ptr<ASTNode> parseFunctionCall(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors) {
-    string funcName = tokens[currentTokenIndex].value;
+// Parses "if (condition) {" and returns the condition, or nullptr after
+// recording an error
+static ASTNode* parseIfHeader(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors) {
+    currentTokenIndex++; // skip 'if'
+    if (tokens.type(currentTokenIndex) != TokenType::LPAREN) {
+        errors.push_back("Expected '(' after 'if'");
+        return nullptr;
+    }
+    currentTokenIndex++; // skip '('
+    auto condition = parseExpression(tokens, currentTokenIndex, arena, errors);
+    if (!condition) {
+        errors.push_back("Invalid condition in if statement");
+        return nullptr;
+    }
+    if (tokens.type(currentTokenIndex) != TokenType::RPAREN) {
+        errors.push_back("Expected ')' after if condition");
+        return nullptr;
+    }
+    currentTokenIndex++; // skip ')'
+    if (tokens.type(currentTokenIndex) != TokenType::LBRACE) {
+        errors.push_back("Expected '{' after if condition");
+        return nullptr;
+    }
+    currentTokenIndex++; // skip '{'
+    return condition;
+}
+
+// An if statement whose then or else block is still being parsed
+struct OpenIf {
+    ASTNode* condition;
+    ASTNode* thenBlock;
+    ASTNode* elseBlock; // set once "else {" has been consumed
+    ASTNode* block() const { return elseBlock ? elseBlock : thenBlock; }
+};
+
+// Parses statements into body up to its closing '}' or END, which are left
+// for the caller. Nested if/else blocks are kept on an explicit stack, so
+// nesting depth is not limited by the call stack.
+void parseStatements(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors, ASTNode* body) {
+    vector<OpenIf> open;
+    while (true) {
+        ASTNode* block = open.empty() ? body : open.back().block();
+        TokenType type = tokens.type(currentTokenIndex);
+        if (type == TokenType::IF) {
+            ASTNode* condition = parseIfHeader(tokens, currentTokenIndex, arena, errors);
+            if (condition) open.push_back({condition, arena.make<ASTNode>(NodeKind::Block), nullptr});
+            continue;
+        }
+        if (type != TokenType::RBRACE && type != TokenType::END) {
+            auto stmt = parseStatement(tokens, currentTokenIndex, arena, errors);
+            if (stmt) block->addChild(stmt);
+            continue;
+        }
+        if (open.empty()) return;
+
+        // Close the innermost if or else block. On error the whole if
+        // statement is dropped and parsing resumes in the enclosing block.
+        OpenIf current = open.back();
+        open.pop_back();
+        if (type != TokenType::RBRACE) {
+            errors.push_back(current.elseBlock ? "Expected '}' at end of else block" : "Expected '}' at end of if block");
+            continue;
+        }
+        currentTokenIndex++; // skip '}'
+        if (!current.elseBlock && tokens.type(currentTokenIndex) == TokenType::ELSE) {
+            currentTokenIndex++; // skip 'else'
+            if (tokens.type(currentTokenIndex) != TokenType::LBRACE) {
+                errors.push_back("Expected '{' after 'else'");
+                continue;
+            }
+            currentTokenIndex++; // skip '{'
+            current.elseBlock = arena.make<ASTNode>(NodeKind::Block);
+            open.push_back(current);
+            continue;
+        }
+        auto ifElseNode = arena.make<ASTNode>(NodeKind::IfElse);
+        ifElseNode->addChild(current.condition);
+        ifElseNode->addChild(current.thenBlock);
+        if (current.elseBlock) ifElseNode->addChild(current.elseBlock);
+        (open.empty() ? body : open.back().block())->addChild(ifElseNode);
+    }
+}
+
+ASTNode* parseFunctionCall(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors) {
+    string_view funcName = tokens.value(currentTokenIndex);
     currentTokenIndex++; // skip ID
-    if (tokens[currentTokenIndex].type != TokenType::LPAREN) {
-        errors.push_back("Expected '(' after function name '" + funcName + "'");
+    if (tokens.type(currentTokenIndex) != TokenType::LPAREN) {
+        errors.push_back("Expected '(' after function name '" + string(funcName) + "'");
         return nullptr;
     }
     currentTokenIndex++; // skip '('
-    auto funcCall = make_shared<ASTNode>("FunctionCall", funcName);
+    auto funcCall = arena.make<ASTNode>(NodeKind::FunctionCall, funcName);
     // Parse arguments (comma-separated expressions)
     bool first = true;
-    while (tokens[currentTokenIndex].type != TokenType::RPAREN && tokens[currentTokenIndex].type != TokenType::END) {
+    while (tokens.type(currentTokenIndex) != TokenType::RPAREN && tokens.type(currentTokenIndex) != TokenType::END) {
         if (!first) {
-            if (tokens[currentTokenIndex].type == TokenType::COMMA) {
+            if (tokens.type(currentTokenIndex) == TokenType::COMMA) {
                 currentTokenIndex++; // skip ','
             } else {
                 errors.push_back("Expected ',' between function arguments");
                 return nullptr;
             }
         }
-        auto arg = parseExpression(tokens, currentTokenIndex, errors);
+        auto arg = parseExpression(tokens, currentTokenIndex, arena, errors);
         if (!arg) return nullptr;
         funcCall->addChild(arg);
         first = false;
     }
-    if (tokens[currentTokenIndex].type != TokenType::RPAREN) {
+    if (tokens.type(currentTokenIndex) != TokenType::RPAREN) {
         errors.push_back("Expected ')' after function arguments");
         return nullptr;
     }
     currentTokenIndex++; // skip ')'
-    if (tokens[currentTokenIndex].type != TokenType::SEMI) {
+    if (tokens.type(currentTokenIndex) != TokenType::SEMI) {
         errors.push_back("Expected ';' after function call");
         return nullptr;
     }
@@ -476,17 +517,17 @@ shared_ptr<ASTNode> parseFunctionCall(const vector<Token>& tokens, size_t& curre
     return funcCall;
 }
 
-shared_ptr<ASTNode> parsePrimary(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors) {
-    if (tokens[currentTokenIndex].type == TokenType::ID) {
-        auto node = make_shared<ASTNode>("Identifier", tokens[currentTokenIndex].value);
+ASTNode* parsePrimary(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors) {
+    if (tokens.type(currentTokenIndex) == TokenType::ID) {
+        auto node = arena.make<ASTNode>(NodeKind::Identifier, tokens.value(currentTokenIndex));
         currentTokenIndex++;
         return node;
-    } else if (tokens[currentTokenIndex].type == TokenType::NUMBER) {
-        auto node = make_shared<ASTNode>("NumberLiteral", tokens[currentTokenIndex].value);
+    } else if (tokens.type(currentTokenIndex) == TokenType::NUMBER) {
+        auto node = arena.make<ASTNode>(NodeKind::NumberLiteral, tokens.value(currentTokenIndex));
         currentTokenIndex++;
         return node;
-    } else if (tokens[currentTokenIndex].type == TokenType::STRING) {
-        auto node = make_shared<ASTNode>("StringLiteral", tokens[currentTokenIndex].value);
+    } else if (tokens.type(currentTokenIndex) == TokenType::STRING) {
+        auto node = arena.make<ASTNode>(NodeKind::StringLiteral, tokens.value(currentTokenIndex));
         currentTokenIndex++;
         return node;
     } else {
@@ -495,30 +536,46 @@ shared_ptr<ASTNode> parsePrimary(const vector<Token>& tokens, size_t& currentTok
     }
 }
 
-int getPrecedence(const string& op) {
+int getPrecedence(string_view op) {
     if (op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=") return 0;
     if (op == "+" || op == "-") return 1;
-    if (op == "*" || op == "/") return 2;
+    if (op == "*" || op == "/" || op == "%") return 2;
     return -1;
 }
 
-shared_ptr<ASTNode> parseExpression(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors, int minPrec) {
-    auto left = parsePrimary(tokens, currentTokenIndex, errors);
-    while (true) {
-        string op = tokens[currentTokenIndex].value;
+// Operator-precedence parsing with explicit operand and operator stacks
+// (shunting-yard), so long operator chains need no recursion. Operators of
+// equal precedence associate to the left.
+ASTNode* parseExpression(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors) {
+    struct PendingOp {
+        string_view op;
+        int prec;
+    };
+    vector<ASTNode*> operands;
+    vector<PendingOp> operators;
+    auto reduce = [&]() {
+        auto bin = arena.make<ASTNode>(NodeKind::BinaryExpr, operators.back().op);
+        operators.pop_back();
+        ASTNode* right = operands.back();
+        operands.pop_back();
+        bin->addChild(operands.back());
+        bin->addChild(right);
+        uint8_t left = operands.back() ? operands.back()->registers : 0;
+        bin->registers = left == right->registers ? min(left + 1, UINT8_MAX) : max(left, right->registers);
+        operands.back() = bin;
+    };
+    operands.push_back(parsePrimary(tokens, currentTokenIndex, arena, errors));
+    while (tokens.type(currentTokenIndex) == TokenType::OP || tokens.type(currentTokenIndex) == TokenType::COMPARE) {
+        string_view op = tokens.value(currentTokenIndex);
         int prec = getPrecedence(op);
-        if ((tokens[currentTokenIndex].type == TokenType::OP || tokens[currentTokenIndex].type == TokenType::COMPARE) && prec >= minPrec) {
-            currentTokenIndex++;
-            auto right = parseExpression(tokens, currentTokenIndex, errors, prec + 1);
-            if (!right) return nullptr;
-            auto bin = make_shared<ASTNode>("BinaryExpr", op);
-            bin->addChild(left);
-            bin->addChild(right);
-            left = bin;
-        } else {
-            break;
-        }
+        if (prec < 0) break;
+        while (!operators.empty() && operators.back().prec >= prec) reduce();
+        operators.push_back({op, prec});
+        currentTokenIndex++;
+        auto right = parsePrimary(tokens, currentTokenIndex, arena, errors);
+        if (!right) return nullptr;
+        operands.push_back(right);
     }
-    return left;
+    while (!operators.empty()) reduce();
+    return operands.back();
 }
- 
\ No newline at end of file
@@ -1,31 +1,57 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <cstdint>
 #include <vector>
 #include <string>
-#include <memory>
+#include <string_view>
+#include "arena.hpp"
 using namespace std;
 
-enum class TokenType;
-struct Token;
+enum class TokenType : uint8_t;
+struct TokenStream;
+struct IRModule;
+struct JsonWriter;
 
+enum class NodeKind : uint8_t {
+    Program, FunctionDecl, Block, Declaration, Assignment, IfElse, Return,
+    FunctionCall, BinaryExpr, Identifier, NumberLiteral, StringLiteral
+};
+
+const char* nodeKindName(NodeKind kind);
+
+// AST nodes live in an Arena and are never freed individually. Children
+// form an intrusive singly-linked list; value is a view into the source
+// (or into the arena for synthesized text).
 struct ASTNode {
-    string nodeType;
-    vector<shared_ptr<ASTNode>> children;
-    string value;
-    int indentLevel = 0;
-    ASTNode(string type, string val = "") : nodeType(type), value(val) {}
-    void addChild(shared_ptr<ASTNode> child) {
-        child->indentLevel = indentLevel + 1;
-        children.push_back(child);
+    NodeKind kind;
+    // Sethi-Ullman number of an expression: the temporaries it needs to be
+    // evaluated. Leaves need none; they are used where they are.
+    uint8_t registers = 0;
+    string_view value;
+    ASTNode* firstChild = nullptr;
+    ASTNode* lastChild = nullptr;
+    ASTNode* next = nullptr;
+    uint32_t childCount = 0;
+    ASTNode(NodeKind k, string_view val = {}) : kind(k), value(val) {}
+    void addChild(ASTNode* child) {
+        if (lastChild) lastChild->next = child;
+        else firstChild = child;
+        lastChild = child;
+        childCount++;
+    }
+    ASTNode* child(size_t index) const {
+        ASTNode* node = firstChild;
+        while (index-- && node) node = node->next;
+        return node;
     }
-    void print() const;
+    void print(int depth = 0) const;
     void printJSON(ostream& out, int indent = 0) const;
-    string generateIntermediateCode(vector<string>& code, int& tempCount);
-    string getRegister(int idx) const;
-    string generateAssembly(vector<string>& asmCode, vector<pair<string, string>>& stringLiterals, int& regCount, const string& currentFunc = "") const;
+    // The same tree as printJSON, compact and with values escaped
+    void writeJSON(JsonWriter& json) const;
+    void generateIntermediateCode(IRModule& module) const;
 };
 
-shared_ptr<ASTNode> parseProgram(const vector<Token>& tokens, size_t& currentTokenIndex, vector<string>& errors);
+ASTNode* parseProgram(const TokenStream& tokens, size_t& currentTokenIndex, Arena& arena, vector<string>& errors);
 
-#endif // PARSER_HPP 
\ No newline at end of file
+#endif // PARSER_HPP
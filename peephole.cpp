@@ -0,0 +1,267 @@
+#include "peephole.hpp"
+
+// esp and ebp hold the frame; no rule may treat them as dead
+static const uint16_t pinnedRegisters = regBit(Reg::ESP) | regBit(Reg::EBP);
+
+static uint16_t addressRegisters(const MOperand& operand) {
+    if (!operand.isMem()) return 0;
+    uint16_t mask = 0;
+    if (operand.base != Reg::None) mask |= regBit(operand.base);
+    if (operand.index != Reg::None) mask |= regBit(operand.index);
+    return mask;
+}
+
+// Registers an operand reads when used as a source
+static uint16_t sourceRegisters(const MOperand& operand) {
+    return operand.isReg() ? regBit(operand.base) : addressRegisters(operand);
+}
+
+// Registers an instruction reads and writes, as regBit() masks
+struct RegisterEffect {
+    uint16_t reads;
+    uint16_t writes;
+};
+
+static RegisterEffect effect(const MInstr& instr, const CallingConvention& convention) {
+    const uint16_t eax = regBit(Reg::EAX), edx = regBit(Reg::EDX);
+    uint16_t dst = instr.dst.isReg() ? regBit(instr.dst.base) : 0;
+    uint16_t address = addressRegisters(instr.dst);
+    uint16_t src = sourceRegisters(instr.src);
+    switch (instr.op) {
+    case MOp::Mov:
+    case MOp::Movzx:
+    case MOp::Lea:
+    case MOp::Pop:
+        return {static_cast<uint16_t>(address | src), dst};
+    case MOp::Imul:
+        // One operand: edx:eax = eax * dst
+        if (instr.src.isNone()) return {static_cast<uint16_t>(eax | sourceRegisters(instr.dst)), static_cast<uint16_t>(eax | edx)};
+        if (!instr.src2.isNone()) return {src, dst};
+        return {static_cast<uint16_t>(dst | address | src), dst};
+    case MOp::Cmp:
+    case MOp::Test:
+    case MOp::Push:
+        return {static_cast<uint16_t>(sourceRegisters(instr.dst) | src), 0};
+    case MOp::Cdq: return {eax, edx};
+    case MOp::Idiv: return {static_cast<uint16_t>(eax | edx | sourceRegisters(instr.dst)), static_cast<uint16_t>(eax | edx)};
+    case MOp::Call: {
+        // Every argument register, and al on x86-64 for variadic callees
+        uint16_t arguments = convention.target == Target::X64 ? eax : 0;
+        for (Reg reg : convention.argumentRegisters) arguments |= regBit(reg);
+        return {arguments, convention.callerSaved};
+    }
+    case MOp::Ret: return {static_cast<uint16_t>(eax | convention.calleeSaved), 0};
+    case MOp::Jmp:
+    case MOp::Jcc:
+    case MOp::Label:
+        return {0, 0};
+    default:
+        // Read-modify-write: add, sub, and, xor, shifts, neg, setcc
+        return {static_cast<uint16_t>(dst | address | src), dst};
+    }
+}
+
+static bool writesFlags(MOp op) {
+    switch (op) {
+    case MOp::Add:
+    case MOp::Sub:
+    case MOp::Imul:
+    case MOp::Neg:
+    case MOp::Idiv:
+    case MOp::And:
+    case MOp::Xor:
+    case MOp::Shl:
+    case MOp::Sar:
+    case MOp::Shr:
+    case MOp::Cmp:
+    case MOp::Test:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Registers live after each instruction. Jumps only go forward, so the
+// second backward sweep normally confirms the first.
+static void computeLiveness(const MFunction& function, vector<uint16_t>& live) {
+    const vector<MInstr>& code = function.code;
+    const CallingConvention& convention = callingConvention(function.target);
+    uint32_t n = code.size();
+    vector<uint32_t> labelAt(function.exitLabel + 1, n);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (code[i].op == MOp::Label) labelAt[code[i].dst.value] = i;
+    }
+    live.assign(n, 0);
+    vector<uint16_t> before(n + 1, 0);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t i = n; i-- > 0;) {
+            const MInstr& instr = code[i];
+            uint16_t out = before[i + 1];
+            if (instr.op == MOp::Jmp) out = before[labelAt[instr.dst.value]];
+            else if (instr.op == MOp::Jcc) out |= before[labelAt[instr.dst.value]];
+            else if (instr.op == MOp::Ret) out = 0;
+            live[i] = out;
+            RegisterEffect e = effect(instr, convention);
+            uint16_t in = e.reads | (out & ~e.writes);
+            if (in != before[i]) {
+                before[i] = in;
+                changed = true;
+            }
+        }
+    }
+}
+
+// The instructions a rule looks at, from position at of the code
+struct Window {
+    const vector<MInstr>& code;
+    const vector<uint16_t>& live;
+    uint32_t at;
+
+    const MInstr& operator[](uint32_t k) const { return code[at + k]; }
+    // Whether the window's k-th instruction leaves reg dead
+    bool dead(uint32_t k, const MOperand& reg) const {
+        uint16_t bit = regBit(reg.base);
+        return !(bit & pinnedRegisters) && !(live[at + k] & bit);
+    }
+    // Whether the flags are rewritten after the k-th instruction before
+    // anything reads them; unknown across jumps and labels
+    bool flagsDead(uint32_t k) const {
+        for (uint32_t p = at + k + 1; p < code.size(); ++p) {
+            MOp op = code[p].op;
+            if (op == MOp::Jcc || op == MOp::Setcc || op == MOp::Jmp || op == MOp::Label) return false;
+            if (writesFlags(op) || op == MOp::Call || op == MOp::Ret) return true;
+        }
+        return true;
+    }
+};
+
+static constexpr uint32_t ops(MOp op) { return 1u << static_cast<unsigned>(op); }
+template <typename... Rest>
+static constexpr uint32_t ops(MOp op, Rest... rest) { return ops(op) | ops(rest...); }
+
+// A rule matches a window whose k-th opcode is in opcodes[k]; rewrite
+// then checks the operands and, on success, appends the replacement
+struct PeepholeRule {
+    const char* name;
+    uint32_t length;
+    uint32_t opcodes[3];
+    bool (*rewrite)(const Window& window, vector<MInstr>& out);
+};
+
+static const PeepholeRule rules[] = {
+    // mov r, r
+    {"self-move", 1, {ops(MOp::Mov)},
+     [](const Window& w, vector<MInstr>&) { return w[0].dst == w[0].src; }},
+    // push x; pop y -> mov y, x
+    {"push-pop", 2, {ops(MOp::Push), ops(MOp::Pop)},
+     [](const Window& w, vector<MInstr>& out) {
+         if (w[0].dst.isMem() && w[1].dst.isMem()) return false;
+         if (w[0].dst != w[1].dst) out.push_back({MOp::Mov, Cond::E, w[1].dst, w[0].dst, {}});
+         return true;
+     }},
+    // mov [m], x; mov r, [m] -> mov [m], x; mov r, x
+    {"store-load", 2, {ops(MOp::Mov), ops(MOp::Mov)},
+     [](const Window& w, vector<MInstr>& out) {
+         if (!w[0].dst.isMem() || w[1].src != w[0].dst || w[0].src.isMem()) return false;
+         out.push_back(w[0]);
+         if (w[1].dst != w[0].src) out.push_back({MOp::Mov, Cond::E, w[1].dst, w[0].src, {}});
+         return true;
+     }},
+    // jmp L; L:
+    {"jump-to-next", 2, {ops(MOp::Jmp, MOp::Jcc), ops(MOp::Label)},
+     [](const Window& w, vector<MInstr>& out) {
+         if (w[0].dst != w[1].dst) return false;
+         out.push_back(w[1]);
+         return true;
+     }},
+    // mov t, a; op t, b; mov d, t -> mov d, a; op d, b when t dies, or
+    // op d, a when op commutes and b is d
+    {"two-address-coalesce", 3,
+     {ops(MOp::Mov), ops(MOp::Add, MOp::Sub, MOp::Imul, MOp::And, MOp::Xor, MOp::Shl, MOp::Sar, MOp::Shr, MOp::Neg),
+      ops(MOp::Mov)},
+     [](const Window& w, vector<MInstr>& out) {
+         const MOperand& t = w[0].dst;
+         const MOperand& d = w[2].dst;
+         if (!t.isReg() || w[1].dst != t || w[2].src != t || !d.isReg() || d == t || !w.dead(2, t)) return false;
+         if (sourceRegisters(w[1].src) & regBit(t.base)) return false;
+         if (w[1].op == MOp::Imul && (w[1].src.isNone() || !w[1].src2.isNone())) return false;
+         if (w[1].src == d) {
+             bool commutes = w[1].op == MOp::Add || w[1].op == MOp::Imul || w[1].op == MOp::And || w[1].op == MOp::Xor;
+             if (!commutes) return false;
+             out.push_back({w[1].op, Cond::E, d, w[0].src, {}});
+             return true;
+         }
+         if (sourceRegisters(w[1].src) & regBit(d.base)) return false;
+         out.push_back({MOp::Mov, Cond::E, d, w[0].src, {}});
+         out.push_back({w[1].op, Cond::E, d, w[1].src, {}});
+         return true;
+     }},
+    // mov/lea/movzx/imul t, ...; mov d, t -> the first writing d, when t dies
+    {"forward-result", 2, {ops(MOp::Mov, MOp::Lea, MOp::Movzx, MOp::Imul), ops(MOp::Mov)},
+     [](const Window& w, vector<MInstr>& out) {
+         const MOperand& t = w[0].dst;
+         const MOperand& d = w[1].dst;
+         if (!t.isReg() || w[1].src != t || !w.dead(1, t)) return false;
+         if (w[0].op == MOp::Imul && w[0].src2.isNone()) return false;
+         if (!d.isReg() && (w[0].op != MOp::Mov || w[0].src.isMem())) return false;
+         out.push_back(w[0]);
+         out.back().dst = d;
+         return true;
+     }},
+    // cmp r, 0 -> test r, r
+    {"compare-zero", 1, {ops(MOp::Cmp)},
+     [](const Window& w, vector<MInstr>& out) {
+         if (!w[0].dst.isReg() || w[0].src != MOperand::imm(0)) return false;
+         out.push_back({MOp::Test, Cond::E, w[0].dst, w[0].dst, {}});
+         return true;
+     }},
+    // mov r, 0 -> xor r, r when the flags are not needed
+    {"zero-idiom", 1, {ops(MOp::Mov)},
+     [](const Window& w, vector<MInstr>& out) {
+         if (!w[0].dst.isReg() || w[0].src != MOperand::imm(0) || !w.flagsDead(0)) return false;
+         out.push_back({MOp::Xor, Cond::E, w[0].dst, w[0].dst, {}});
+         return true;
+     }},
+};
+
+static void peepholeFunction(MFunction& function, PeepholeReport& report) {
+    vector<MInstr>& code = function.code;
+    vector<uint16_t> live;
+    vector<MInstr> rewritten, replacement;
+    // Windows of one sweep do not overlap, and a rewrite keeps the
+    // registers live around its window, so liveness holds for the sweep
+    for (bool changed = true; changed;) {
+        changed = false;
+        computeLiveness(function, live);
+        rewritten.clear();
+        for (uint32_t i = 0; i < code.size();) {
+            Window window{code, live, i};
+            uint32_t matched = 0;
+            for (size_t r = 0; r < size(rules) && matched == 0; ++r) {
+                const PeepholeRule& rule = rules[r];
+                if (i + rule.length > code.size()) continue;
+                bool opcodes = true;
+                for (uint32_t k = 0; k < rule.length; ++k) opcodes = opcodes && (rule.opcodes[k] & ops(code[i + k].op));
+                replacement.clear();
+                if (!opcodes || !rule.rewrite(window, replacement)) continue;
+                matched = rule.length;
+                report.rules[r].second++;
+            }
+            if (matched == 0) {
+                rewritten.push_back(code[i++]);
+                continue;
+            }
+            rewritten.insert(rewritten.end(), replacement.begin(), replacement.end());
+            i += matched;
+            changed = true;
+        }
+        code.swap(rewritten);
+    }
+}
+
+void peephole(vector<MFunction>& functions, PeepholeReport& report) {
+    report.rules.clear();
+    for (const PeepholeRule& rule : rules) report.rules.push_back({rule.name, 0});
+    for (MFunction& function : functions) peepholeFunction(function, report);
+}
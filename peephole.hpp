@@ -0,0 +1,20 @@
+#ifndef PEEPHOLE_HPP
+#define PEEPHOLE_HPP
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "x86.hpp"
+using namespace std;
+
+struct PeepholeReport {
+    vector<pair<string, size_t>> rules; // rewrites by each rule, in table order
+};
+
+// Window rewrites over the finished machine code, by a table of rules
+// tried at each instruction in turn and applied to a fixpoint. Rules that
+// drop a register's value consult its liveness over the function's jumps.
+void peephole(vector<MFunction>& functions, PeepholeReport& report);
+
+#endif // PEEPHOLE_HPP
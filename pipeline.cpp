@@ -0,0 +1,507 @@
+#include "pipeline.hpp"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "peephole.hpp"
+#include "encoder.hpp"
+#include "elf.hpp"
+#include "jit.hpp"
+#include "vm.hpp"
+#include "json.hpp"
+
+// --run: a program runs at most this long
+const uint32_t runTimeoutMs = 2000;
+
+bool applyOption(string_view option, CompileOptions& options) {
+    if (option == "-O") options.optimize = true;
+    else if (option == "-m64") options.target = Target::X64;
+    else if (option == "--run") options.run = true;
+    else if (option == "--interpret") options.interpret = true;
+    else if (option.substr(0, 7) == "--emit=") {
+        // A comma-separated list of phases
+        uint8_t phases = 0;
+        string_view list = option.substr(7);
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            string_view phase = list.substr(0, comma);
+            list = comma == string_view::npos ? string_view() : list.substr(comma + 1);
+            if (phase == "tokens") phases |= EmitTokens;
+            else if (phase == "ast") phases |= EmitAst;
+            else if (phase == "tac") phases |= EmitTac;
+            else if (phase == "asm") phases |= EmitAsm;
+            else return false;
+        }
+        if (!phases) return false;
+        options.emit = phases;
+    } else return false;
+    return true;
+}
+
+CompileOptions pooledOptions(const CompileOptions& options) {
+    CompileOptions pooled = options;
+    pooled.lexerThreads = 1;
+    return pooled;
+}
+
+bool checkOptions(CompileOptions& options, string& reason) {
+    // --interpret stops short of the backend, so it has no code to write or run
+    if (options.interpret && (options.objectPath || options.run)) {
+        reason = options.run ? "--interpret cannot be combined with --run" : "--interpret cannot be combined with -o";
+        return false;
+    }
+    // The program runs on the host, which is x86-64
+    if (options.run) options.target = Target::X64;
+    return true;
+}
+
+// The phases from source to machine code, in the order they run
+enum class Phase : uint8_t { Tokens, Ast, Semantic, Tac, Asm };
+
+// What an entry point does with each phase as the pipeline runs: begin
+// comes before a phase, the others after it succeeds, except tokens,
+// which also comes when lexing reported errors. Phases after last are
+// not run.
+struct PhaseListener {
+    Phase last = Phase::Asm;
+
+    virtual ~PhaseListener() = default;
+    virtual void begin(Phase) {}
+    virtual void tokens(const TokenStream&) {}
+    virtual void ast(const ASTNode*) {}
+    virtual void analyzed() {}
+    virtual void tac(const IRModule&) {} // as generated, before -O
+    virtual void optimized(const IRModule&, const OptimizationReport&) {}
+    virtual void assembly(const IRModule&, const vector<MFunction>&, const PeepholeReport&) {}
+};
+
+// One source on its way through runPhases. The module keeps views into
+// the source, and the AST lives in the arena.
+struct Compilation {
+    vector<string> errors;
+    Phase failed = Phase::Tokens; // the phase that reported errors
+    TokenStream tokens;
+    Arena arena;
+    ASTNode* ast = nullptr;
+    IRModule module;
+    vector<MFunction> functions;
+};
+
+// The sequence every entry point shares: the front end down to the
+// intermediate code, -O, then machine code for options.target, as far
+// as listener.last. False when a phase reported errors.
+static bool runPhases(string_view source, const CompileOptions& options, Compilation& c, PhaseListener& listener) {
+    listener.begin(Phase::Tokens);
+    tokenizeParallel(source, c.tokens, c.errors, options.lexerThreads);
+    listener.tokens(c.tokens);
+    if (!c.errors.empty()) return false;
+    if (listener.last < Phase::Ast) return true;
+
+    listener.begin(Phase::Ast);
+    size_t currentTokenIndex = 0;
+    c.ast = parseProgram(c.tokens, currentTokenIndex, c.arena, c.errors);
+    c.failed = Phase::Ast;
+    if (!c.errors.empty()) return false;
+    listener.ast(c.ast);
+    if (listener.last < Phase::Semantic) return true;
+
+    listener.begin(Phase::Semantic);
+    SymbolTable symbolTable;
+    semanticAnalysis(c.ast, symbolTable, c.errors);
+    c.failed = Phase::Semantic;
+    if (!c.errors.empty()) return false;
+    listener.analyzed();
+    if (listener.last < Phase::Tac) return true;
+
+    listener.begin(Phase::Tac);
+    generateIntermediateCode(c.ast, c.module);
+    listener.tac(c.module);
+    if (options.optimize) {
+        OptimizationReport report;
+        optimize(c.module, report);
+        listener.optimized(c.module, report);
+    }
+    if (listener.last < Phase::Asm) return true;
+
+    listener.begin(Phase::Asm);
+    generateMachineCode(c.module, options.target, c.functions);
+    PeepholeReport peepholeReport;
+    peephole(c.functions, peepholeReport);
+    listener.assembly(c.module, c.functions, peepholeReport);
+    return true;
+}
+
+// -o: the encoded module as an ELF object. False when the file could not
+// be written.
+static bool writeObjectFile(const char* path, const IRModule& module, const MachineCode& machineCode) {
+    vector<uint8_t> object;
+    writeObject(module, machineCode, object);
+    ofstream file(path, ios::binary);
+    file.write(reinterpret_cast<const char*>(object.data()), object.size());
+    return static_cast<bool>(file);
+}
+
+// Every phase as text, each under its own heading
+struct ReportListener : PhaseListener {
+    ostream& out;
+
+    explicit ReportListener(ostream& out) : out(out) {}
+
+    void begin(Phase phase) override {
+        switch (phase) {
+            case Phase::Tokens: out << "=== Lexical Analysis (Tokenization) ===\n"; break;
+            case Phase::Ast: out << "\n=== Syntax Analysis (Parsing) ===\n"; break;
+            case Phase::Semantic: out << "\n=== Semantic Analysis ===\n"; break;
+            case Phase::Tac: out << "\n=== Intermediate Code Generation ===\n"; break;
+            case Phase::Asm: out << "\n=== Assembly Code Generation ===\n"; break;
+        }
+    }
+
+    void tokens(const TokenStream& tokens) override {
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            out << "Line " << tokens.line(i) << ", Column " << tokens.column(i) << ": ";
+            switch (tokens.type(i)) {
+                case TokenType::INT: out << "Keyword (int)"; break;
+                case TokenType::RETURN: out << "Keyword (return)"; break;
+                case TokenType::IF: out << "Keyword (if)"; break;
+                case TokenType::ELSE: out << "Keyword (else)"; break;
+                case TokenType::ID: out << "ID"; break;
+                case TokenType::NUMBER: out << "NUMBER"; break;
+                case TokenType::STRING: out << "STRING"; break;
+                case TokenType::OP: out << "OP"; break;
+                case TokenType::COMPARE: out << "COMPARE"; break;
+                case TokenType::ASSIGN: out << "ASSIGN"; break;
+                case TokenType::LPAREN: out << "LPAREN"; break;
+                case TokenType::RPAREN: out << "RPAREN"; break;
+                case TokenType::LBRACE: out << "LBRACE"; break;
+                case TokenType::RBRACE: out << "RBRACE"; break;
+                case TokenType::SEMI: out << "SEMI"; break;
+                case TokenType::COMMA: out << "COMMA"; break;
+                case TokenType::END: out << "END"; break;
+            }
+            out << " = " << tokens.value(i) << '\n';
+        }
+    }
+
+    void ast(const ASTNode* ast) override {
+        out << "\nParse Tree (JSON):\n";
+        if (ast) ast->printJSON(out, 0);
+        out << '\n';
+    }
+
+    void analyzed() override { out << "Semantic analysis passed!\n"; }
+
+    void tac(const IRModule& module) override {
+        vector<string> intermediateCode;
+        formatIR(module, intermediateCode);
+        out << "\nIntermediate Code (Three-Address Code):\n";
+        for (size_t i = 0; i < intermediateCode.size(); ++i) {
+            out << i << ": " << intermediateCode[i] << '\n';
+        }
+    }
+
+    void optimized(const IRModule& module, const OptimizationReport& report) override {
+        out << "\n=== Optimization ===\n";
+        for (const auto& [pass, removed] : report.passes) {
+            out << pass << ": " << removed << " instructions eliminated\n";
+        }
+        out << "Total: " << report.instructionsBefore << " -> " << report.instructionsAfter << " instructions ("
+            << static_cast<ptrdiff_t>(report.instructionsBefore - report.instructionsAfter) << " eliminated)\n";
+        vector<string> intermediateCode;
+        formatIR(module, intermediateCode);
+        out << "\nOptimized Intermediate Code:\n";
+        for (size_t i = 0; i < intermediateCode.size(); ++i) {
+            out << i << ": " << intermediateCode[i] << '\n';
+        }
+    }
+
+    void assembly(const IRModule& module, const vector<MFunction>& functions,
+                  const PeepholeReport& peepholeReport) override {
+        out << "\nPeephole Optimization:\n";
+        for (const auto& [rule, hits] : peepholeReport.rules) {
+            out << rule << ": " << hits << " rewrites\n";
+        }
+        vector<string> asmCode;
+        formatAssembly(module, functions, asmCode);
+        out << "\nAssembly Code:\n";
+        for (size_t i = 0; i < asmCode.size(); ++i) {
+            out << i << ": " << asmCode[i] << '\n';
+        }
+    }
+};
+
+static int compileReport(string_view source, const CompileOptions& options, ostream& out) {
+    out << "=== Source Code ===\n";
+    out << source << "\n\n";
+
+    Compilation c;
+    ReportListener report(out);
+    // --interpret stops at the intermediate code
+    if (options.interpret) report.last = Phase::Tac;
+    if (!runPhases(source, options, c, report)) {
+        out << "\nCompilation errors:\n";
+        for (const auto& error : c.errors) {
+            out << error << '\n';
+        }
+        return 1;
+    }
+
+    // Interpretation (--interpret), straight from the intermediate code
+    // with no assembly step
+    if (options.interpret) {
+        out << "\n=== Interpretation ===\n";
+        BytecodeProgram program;
+        string error;
+        if (!compileBytecode(c.module, program, error)) {
+            out << "\nInterpret error: " << error << '\n';
+            return 1;
+        }
+        out << "\nBytecode:\n";
+        for (const BytecodeFunction& function : program.functions) {
+            out << function.name << ": " << function.registers.size() << " registers\n";
+            for (size_t i = 0; i < function.code.size(); ++i) {
+                out << i << ": " << formatBytecode(function.code[i]) << '\n';
+            }
+        }
+        out << "\nOutput:\n";
+        InterpretResult run;
+        interpret(program, run);
+        out << run.output;
+        if (!run.completed) {
+            out << "\nInterpret error: " << run.error << '\n';
+            return 1;
+        }
+        out << "\nReturn value: " << run.returnValue << " (" << run.instructions << " instructions executed)\n";
+        return 0;
+    }
+
+    MachineCode machineCode;
+    if (options.objectPath || options.run) encodeModule(c.module, c.functions, machineCode);
+
+    // ELF Object File (-o), without an external assembler
+    if (options.objectPath) {
+        out << "\n=== Object File ===\n";
+        if (!writeObjectFile(options.objectPath, c.module, machineCode)) {
+            cerr << "Error: Could not write file '" << options.objectPath << "'" << endl;
+            return 1;
+        }
+        out << options.objectPath << ": " << machineCode.text.size() << " bytes of code, " << machineCode.data.size()
+            << " bytes of data, " << machineCode.relocations.size() << " relocations\n";
+    }
+
+    // Execution (--run), in memory
+    if (options.run) {
+        out << "\n=== Execution ===\n";
+        RunResult run;
+        runInMemory(c.module, machineCode, runTimeoutMs, run);
+        out << run.output;
+        if (!run.completed) {
+            out << "\nRun error: " << run.error << '\n';
+            return 1;
+        }
+        out << "\nReturn value: " << run.returnValue << '\n';
+    }
+    return 0;
+}
+
+static const char* tokenTypeName(TokenType type) {
+    switch (type) {
+        case TokenType::INT: return "INT";
+        case TokenType::RETURN: return "RETURN";
+        case TokenType::IF: return "IF";
+        case TokenType::ELSE: return "ELSE";
+        case TokenType::ID: return "ID";
+        case TokenType::NUMBER: return "NUMBER";
+        case TokenType::STRING: return "STRING";
+        case TokenType::OP: return "OP";
+        case TokenType::COMPARE: return "COMPARE";
+        case TokenType::ASSIGN: return "ASSIGN";
+        case TokenType::LPAREN: return "LPAREN";
+        case TokenType::RPAREN: return "RPAREN";
+        case TokenType::LBRACE: return "LBRACE";
+        case TokenType::RBRACE: return "RBRACE";
+        case TokenType::SEMI: return "SEMI";
+        case TokenType::COMMA: return "COMMA";
+        case TokenType::END: return "END";
+    }
+    return "";
+}
+
+static void writeLines(JsonWriter& json, const char* name, const vector<string>& lines) {
+    json.key(name);
+    json.beginArray();
+    for (const string& line : lines) json.value(line);
+    json.endArray();
+}
+
+// The phases --emit selects, as members of the JSON document
+struct EmitListener : PhaseListener {
+    JsonWriter& json;
+    const CompileOptions& options;
+
+    EmitListener(JsonWriter& json, const CompileOptions& options) : json(json), options(options) {
+        // Only as far as the selection and the actions asked for need;
+        // --interpret stops at the intermediate code
+        bool needCode = (options.emit & EmitAsm) || options.objectPath || options.run;
+        if (needCode && !options.interpret) last = Phase::Asm;
+        else if (needCode || (options.emit & EmitTac) || options.interpret) last = Phase::Tac;
+        else if (options.emit & EmitAst) last = Phase::Ast;
+        else last = Phase::Tokens;
+    }
+
+    void tokens(const TokenStream& tokens) override {
+        if (!(options.emit & EmitTokens)) return;
+        json.key("tokens");
+        json.beginArray();
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            json.beginObject();
+            json.key("line");
+            json.value(static_cast<int64_t>(tokens.line(i)));
+            json.key("column");
+            json.value(static_cast<int64_t>(tokens.column(i)));
+            json.key("type");
+            json.value(tokenTypeName(tokens.type(i)));
+            json.key("value");
+            json.value(tokens.value(i));
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void ast(const ASTNode* ast) override {
+        if (!(options.emit & EmitAst) || !ast) return;
+        json.key("ast");
+        ast->writeJSON(json);
+    }
+
+    // The intermediate code is emitted as it stands after -O
+    void tac(const IRModule& module) override {
+        if (!options.optimize) writeTac(module);
+    }
+    void optimized(const IRModule& module, const OptimizationReport&) override { writeTac(module); }
+
+    void writeTac(const IRModule& module) {
+        if (!(options.emit & EmitTac)) return;
+        vector<string> intermediateCode;
+        formatIR(module, intermediateCode);
+        writeLines(json, "tac", intermediateCode);
+    }
+
+    void assembly(const IRModule& module, const vector<MFunction>& functions, const PeepholeReport&) override {
+        if (!(options.emit & EmitAsm)) return;
+        vector<string> asmCode;
+        formatAssembly(module, functions, asmCode);
+        writeLines(json, "asm", asmCode);
+    }
+};
+
+// The phases behind --emit and the actions after them. When errors stop
+// them, failed names the phase they came from. Returns the exit status.
+static int emitPhases(string_view source, const CompileOptions& options, JsonWriter& json, vector<string>& errors,
+                      const char*& failed) {
+    Compilation c;
+    EmitListener listener(json, options);
+    bool compiled = runPhases(source, options, c, listener);
+    errors = move(c.errors);
+    if (!compiled) {
+        static const char* const names[] = {"tokens", "ast", "semantic"};
+        failed = names[static_cast<int>(c.failed)];
+        return 1;
+    }
+
+    if (options.interpret) {
+        json.key("execution");
+        json.beginObject();
+        BytecodeProgram program;
+        string error;
+        InterpretResult run;
+        if (compileBytecode(c.module, program, error)) {
+            interpret(program, run);
+            json.key("output");
+            json.value(run.output);
+            error = run.error;
+        }
+        if (run.completed) {
+            json.key("returnValue");
+            json.value(static_cast<int64_t>(run.returnValue));
+        } else {
+            json.key("error");
+            json.value(error);
+        }
+        json.endObject();
+        return run.completed ? 0 : 1;
+    }
+    if (listener.last < Phase::Asm) return 0;
+
+    MachineCode machineCode;
+    if (options.objectPath || options.run) encodeModule(c.module, c.functions, machineCode);
+    if (options.objectPath && !writeObjectFile(options.objectPath, c.module, machineCode)) {
+        errors.push_back(string("Could not write file '") + options.objectPath + "'");
+        failed = "object";
+        return 1;
+    }
+    if (options.run) {
+        json.key("execution");
+        json.beginObject();
+        RunResult run;
+        runInMemory(c.module, machineCode, runTimeoutMs, run);
+        json.key("output");
+        json.value(run.output);
+        if (run.completed) {
+            json.key("returnValue");
+            json.value(static_cast<int64_t>(run.returnValue));
+        } else {
+            json.key("error");
+            json.value(run.error);
+        }
+        json.endObject();
+        return run.completed ? 0 : 1;
+    }
+    return 0;
+}
+
+static int compileJSON(string_view source, const CompileOptions& options, ostream& out) {
+    JsonWriter json;
+    json.beginObject();
+    vector<string> errors;
+    const char* failed = nullptr;
+    int status = emitPhases(source, options, json, errors, failed);
+    json.key("errors");
+    json.beginArray();
+    for (const string& error : errors) json.value(error);
+    json.endArray();
+    if (!errors.empty()) {
+        json.key("failed");
+        json.value(failed);
+    }
+    json.key("status");
+    json.value(static_cast<int64_t>(status));
+    json.endObject();
+    json.buffer += '\n';
+    out.write(json.buffer.data(), json.buffer.size());
+    return status;
+}
+
+int compile(string_view source, const CompileOptions& options, ostream& out) {
+    return options.emit ? compileJSON(source, options, out) : compileReport(source, options, out);
+}
+
+bool compileObject(string_view source, const CompileOptions& options, vector<uint8_t>& object,
+                   vector<string>& errors) {
+    Compilation c;
+    PhaseListener quiet;
+    if (!runPhases(source, options, c, quiet)) {
+        errors = move(c.errors);
+        return false;
+    }
+    MachineCode machineCode;
+    encodeModule(c.module, c.functions, machineCode);
+    writeObject(c.module, machineCode, object);
+    return true;
+}
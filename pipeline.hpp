@@ -0,0 +1,57 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "x86.hpp"
+using namespace std;
+
+// Phases --emit can select
+enum EmitPhase : uint8_t { EmitTokens = 1, EmitAst = 2, EmitTac = 4, EmitAsm = 8 };
+
+struct CompileOptions {
+    bool optimize = false;             // -O
+    Target target = Target::X86;       // -m64
+    const char* objectPath = nullptr;  // -o
+    bool run = false;                  // --run
+    bool interpret = false;            // --interpret
+    uint8_t emit = 0;                  // --emit: EmitPhase bits; 0 prints the text report
+    unsigned lexerThreads = 0;         // 0 sizes the lexer's pool to the machine
+};
+
+// Applies one of the flag options, -O, -m64, --run, --interpret or
+// --emit=<phases>. Returns false for anything else.
+bool applyOption(string_view option, CompileOptions& options);
+// The options for compiles run on a pool that keeps every core busy
+// already: the lexer then stays on the calling thread rather than
+// starting a pool of its own on each
+CompileOptions pooledOptions(const CompileOptions& options);
+// Settles the options once all are in: false, with the conflict in
+// reason, when they do not go together
+bool checkOptions(CompileOptions& options, string& reason);
+
+// The whole pipeline for one source, reported to out. Without --emit that
+// is every phase, as text; with it, one JSON document holding just the
+// selected phases, compact and written in a single call:
+//
+//   {"tokens": [{"line", "column", "type", "value"}...], "ast": {...},
+//    "tac": [lines], "asm": [lines], "execution": {"output",
+//    "returnValue" or "error"}, "errors": [messages], "failed", "status": n}
+//
+// "failed" comes only with errors and names the phase they stopped:
+// "tokens", "ast", "semantic", or "object" when -o could not be written.
+// Phases after the last one needed are not run. Keeps no state between
+// calls, so any number can run at once on different threads. Returns the
+// exit status.
+int compile(string_view source, const CompileOptions& options, ostream& out);
+
+// Just the ELF object for a source, with nothing reported: the front end,
+// the backend for options.target and the encoder. False, with errors
+// filled in, when the source does not compile.
+bool compileObject(string_view source, const CompileOptions& options, vector<uint8_t>& object,
+                   vector<string>& errors);
+
+#endif // PIPELINE_HPP
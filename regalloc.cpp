@@ -0,0 +1,261 @@
+#include "regalloc.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+struct LiveInterval {
+    uint32_t value;
+    uint32_t start;
+    uint32_t end;
+    uint16_t allowed; // regBit() mask of registers it may be given
+};
+
+struct LinearBlock {
+    uint32_t from;
+    uint32_t to; // one past the last quad
+    vector<uint32_t> succs;
+    vector<uint32_t> use; // values read before any write, sorted
+    vector<uint32_t> def; // sorted
+    vector<uint32_t> liveIn;
+    vector<uint32_t> liveOut;
+};
+
+bool dividesByShifting(Operand divisor) {
+    if (divisor.kind != OperandKind::Const) return false;
+    uint32_t magnitude = divisor.value < 0 ? 0u - static_cast<uint32_t>(divisor.value) : divisor.value;
+    return magnitude != 0 && (magnitude & (magnitude - 1)) == 0;
+}
+
+// Positions are quad indices
+static void computeIntervals(const IRFunction& function, const CallingConvention& convention,
+                             const vector<uint32_t>& readAt, const RegisterAllocation& allocation,
+                             vector<LiveInterval>& intervals) {
+    const vector<Quad>& code = function.code;
+    uint32_t n = code.size();
+    uint32_t count = allocation.registers.size();
+    // Results of folded quads exist only inside the instruction they fold into
+    vector<bool> folded(count);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (readAt[i] != i && code[i].dst.kind == OperandKind::Temp) folded[code[i].dst.id()] = true;
+    }
+    auto isValue = [&](Operand operand) {
+        return RegisterAllocation::allocated(operand) && !folded[allocation.index(operand)];
+    };
+    auto index = [&](Operand operand) { return allocation.index(operand); };
+
+    // Blocks in code order
+    vector<LinearBlock> blocks;
+    vector<uint32_t> labelBlock(function.labels.size(), 0);
+    bool leader = true;
+    for (uint32_t i = 0; i < n; ++i) {
+        Opcode op = code[i].op;
+        if (leader || op == Opcode::Label) blocks.push_back({i, i, {}, {}, {}, {}, {}});
+        if (op == Opcode::Label) labelBlock[code[i].a.id()] = blocks.size() - 1;
+        blocks.back().to = i + 1;
+        leader = op == Opcode::IfNot || op == Opcode::Goto || op == Opcode::Return;
+    }
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        LinearBlock& block = blocks[b];
+        const Quad& last = code[block.to - 1];
+        if (last.op == Opcode::Goto) {
+            block.succs.push_back(labelBlock[last.a.id()]);
+        } else if (last.op != Opcode::Return) {
+            if (b + 1 < blocks.size()) block.succs.push_back(b + 1);
+            if (last.op == Opcode::IfNot) block.succs.push_back(labelBlock[last.b.id()]);
+        }
+    }
+
+    // Local use and def sets
+    vector<uint32_t> defined(count, UINT32_MAX), used(count, UINT32_MAX);
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        LinearBlock& block = blocks[b];
+        for (uint32_t i = block.from; i < block.to; ++i) {
+            for (Operand operand : {code[i].a, code[i].b}) {
+                if (!isValue(operand)) continue;
+                uint32_t value = index(operand);
+                if (defined[value] == b || used[value] == b) continue;
+                used[value] = b;
+                block.use.push_back(value);
+            }
+            if (isValue(code[i].dst) && defined[index(code[i].dst)] != b) {
+                defined[index(code[i].dst)] = b;
+                block.def.push_back(index(code[i].dst));
+            }
+        }
+        sort(block.use.begin(), block.use.end());
+        sort(block.def.begin(), block.def.end());
+    }
+
+    // Backward dataflow to a fixpoint; one sweep suffices without back edges
+    vector<uint32_t> merged, scratch;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t b = blocks.size(); b-- > 0;) {
+            LinearBlock& block = blocks[b];
+            merged.clear();
+            for (uint32_t s : block.succs) {
+                scratch.clear();
+                set_union(merged.begin(), merged.end(), blocks[s].liveIn.begin(), blocks[s].liveIn.end(),
+                          back_inserter(scratch));
+                merged.swap(scratch);
+            }
+            if (merged == block.liveOut) continue;
+            block.liveOut = merged;
+            scratch.clear();
+            set_difference(merged.begin(), merged.end(), block.def.begin(), block.def.end(), back_inserter(scratch));
+            block.liveIn.clear();
+            set_union(block.use.begin(), block.use.end(), scratch.begin(), scratch.end(), back_inserter(block.liveIn));
+            changed = true;
+        }
+    }
+
+    // One interval per value from its first to its last live position
+    vector<uint32_t> start(count, UINT32_MAX), end(count, 0);
+    vector<bool> read(count);
+    auto extend = [&](uint32_t value, uint32_t position) {
+        start[value] = min(start[value], position);
+        end[value] = max(end[value], position);
+    };
+    for (uint32_t i = 0; i < n; ++i) {
+        const Quad& quad = code[i];
+        if (isValue(quad.dst)) extend(index(quad.dst), i);
+        for (Operand operand : {quad.a, quad.b}) {
+            if (!isValue(operand)) continue;
+            extend(index(operand), readAt[i]);
+            read[index(operand)] = true;
+        }
+    }
+    for (const LinearBlock& block : blocks) {
+        for (uint32_t value : block.liveIn) extend(value, block.from);
+        for (uint32_t value : block.liveOut) extend(value, block.to - 1);
+    }
+
+    // Register constraints from the calls and divisions each interval spans
+    vector<uint32_t> calls, divisions;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (code[i].op == Opcode::Call) calls.push_back(i);
+        bool divides = code[i].op == Opcode::Div || code[i].op == Opcode::Mod;
+        if (divides && !dividesByShifting(code[i].b)) divisions.push_back(i);
+    }
+    // Whether some position p in sorted lies in first <= p <= last
+    auto spans = [](const vector<uint32_t>& sorted, uint32_t first, uint32_t last) {
+        auto it = lower_bound(sorted.begin(), sorted.end(), first);
+        return it != sorted.end() && *it <= last;
+    };
+    uint16_t all = 0;
+    for (Reg reg : convention.allocatable) all |= regBit(reg);
+    for (uint32_t value = 0; value < count; ++value) {
+        if (!read[value]) continue;
+        uint16_t allowed = all;
+        // Still needed after the call returns
+        if (end[value] > start[value] + 1 && spans(calls, start[value] + 1, end[value] - 1)) {
+            allowed &= ~convention.callerSaved;
+        }
+        // cdq or a widening imul overwrites edx before the division reads
+        // its operands
+        if (spans(divisions, start[value] + 1, end[value])) allowed &= ~regBit(Reg::EDX);
+        intervals.push_back({value, start[value], end[value], allowed});
+    }
+}
+
+void allocateRegisters(const IRFunction& function, const CallingConvention& convention, const vector<uint32_t>& readAt,
+                       RegisterAllocation& allocation) {
+    // Variables are numbered module-wide; size for the ones this function uses
+    uint32_t varCount = 0;
+    for (const Quad& quad : function.code) {
+        for (Operand operand : {quad.dst, quad.a, quad.b}) {
+            if (operand.kind == OperandKind::Var) varCount = max(varCount, operand.id() + 1);
+        }
+    }
+    allocation.varBase = function.tempCount;
+    allocation.registers.assign(function.tempCount + varCount, Reg::None);
+    allocation.slots.assign(function.tempCount + varCount, noSlot);
+    allocation.slotCount = 0;
+    allocation.usedRegisters = 0;
+    allocation.spills = 0;
+
+    vector<LiveInterval> intervals;
+    computeIntervals(function, convention, readAt, allocation, intervals);
+    sort(intervals.begin(), intervals.end(), [](const LiveInterval& x, const LiveInterval& y) {
+        return x.start != y.start ? x.start < y.start : x.value < y.value;
+    });
+
+    // Intervals holding a register, by increasing end. An interval ending
+    // where the next one starts frees its register for it: instruction
+    // selection reads every operand before it writes the result.
+    vector<LiveInterval> active;
+    uint16_t freeRegisters = 0;
+    for (Reg reg : convention.allocatable) freeRegisters |= regBit(reg);
+    // Spill slots are reused once the interval holding them ends. Each free
+    // slot remembers where its last holder ended: an interval evicted from
+    // a register is spilled over its whole length, from before the current
+    // position.
+    priority_queue<pair<uint32_t, uint32_t>, vector<pair<uint32_t, uint32_t>>, greater<>> spilledEnds;
+    vector<pair<uint32_t, uint32_t>> freeSlots; // (slot, end of its last holder)
+
+    auto spill = [&](const LiveInterval& interval) {
+        uint32_t slot = allocation.slotCount;
+        for (size_t i = freeSlots.size(); i-- > 0;) {
+            if (freeSlots[i].second > interval.start) continue;
+            slot = freeSlots[i].first;
+            freeSlots.erase(freeSlots.begin() + i);
+            break;
+        }
+        if (slot == allocation.slotCount) allocation.slotCount++;
+        allocation.registers[interval.value] = Reg::None;
+        allocation.slots[interval.value] = slot;
+        spilledEnds.push({interval.end, slot});
+        allocation.spills++;
+    };
+    auto activate = [&](const LiveInterval& interval, Reg reg) {
+        allocation.registers[interval.value] = reg;
+        allocation.usedRegisters |= regBit(reg);
+        freeRegisters &= ~regBit(reg);
+        auto at = upper_bound(active.begin(), active.end(), interval.end,
+                              [](uint32_t end, const LiveInterval& other) { return end < other.end; });
+        active.insert(at, interval);
+    };
+
+    for (const LiveInterval& interval : intervals) {
+        size_t expired = 0;
+        while (expired < active.size() && active[expired].end <= interval.start) {
+            freeRegisters |= regBit(allocation.registers[active[expired].value]);
+            expired++;
+        }
+        active.erase(active.begin(), active.begin() + expired);
+        while (!spilledEnds.empty() && spilledEnds.top().first <= interval.start) {
+            freeSlots.push_back({spilledEnds.top().second, spilledEnds.top().first});
+            spilledEnds.pop();
+        }
+
+        uint16_t candidates = freeRegisters & interval.allowed;
+        if (candidates) {
+            for (Reg reg : convention.allocatable) {
+                if (candidates & regBit(reg)) {
+                    activate(interval, reg);
+                    break;
+                }
+            }
+            continue;
+        }
+        // Under pressure: of this interval and the active ones whose
+        // register it could use, the one that ends last goes to memory
+        size_t victim = active.size();
+        for (size_t i = active.size(); i-- > 0;) {
+            if (interval.allowed & regBit(allocation.registers[active[i].value])) {
+                victim = i;
+                break;
+            }
+        }
+        if (victim == active.size() || active[victim].end <= interval.end) {
+            spill(interval);
+            continue;
+        }
+        LiveInterval evicted = active[victim];
+        Reg reg = allocation.registers[evicted.value];
+        active.erase(active.begin() + victim);
+        spill(evicted);
+        freeRegisters |= regBit(reg);
+        activate(interval, reg);
+    }
+}
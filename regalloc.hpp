@@ -0,0 +1,49 @@
+#ifndef REGALLOC_HPP
+#define REGALLOC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ir.hpp"
+#include "x86.hpp"
+using namespace std;
+
+const uint32_t noSlot = UINT32_MAX;
+
+// Whether instruction selection divides by divisor with shifts alone: a
+// constant power of two of either sign. Other divisions, by idiv or by a
+// reciprocal multiply, overwrite edx.
+bool dividesByShifting(Operand divisor);
+
+// Where each temporary and variable of a function lives: a register or a
+// 4-byte spill slot in the frame. A value that is never read gets neither.
+struct RegisterAllocation {
+    uint32_t varBase = 0;   // values are the temps, then the variables
+    vector<Reg> registers;  // value -> register, Reg::None if not in one
+    vector<uint32_t> slots; // value -> spill slot, noSlot if not spilled
+    uint32_t slotCount = 0;
+    uint16_t usedRegisters = 0; // regBit() mask
+    size_t spills = 0;
+
+    static bool allocated(Operand operand) {
+        return operand.kind == OperandKind::Temp || operand.kind == OperandKind::Var;
+    }
+    uint32_t index(Operand operand) const {
+        return operand.kind == OperandKind::Temp ? operand.id() : varBase + operand.id();
+    }
+};
+
+// Linear scan (Poletto and Sarkar) over one live interval per value,
+// computed from liveness over the function's jumps, handing out the
+// convention's allocatable registers. An interval live across a call
+// avoids the caller-saved registers and one live across an idiv avoids
+// edx; when no register is free the interval that ends last is spilled.
+//
+// readAt comes from instruction selection: the index of the quad whose
+// instructions read quad i's operands. It is i for most quads; a Param is
+// read at its Call, and a quad folded into a later quad's instructions is
+// read there and its result needs no location.
+void allocateRegisters(const IRFunction& function, const CallingConvention& convention, const vector<uint32_t>& readAt,
+                       RegisterAllocation& allocation);
+
+#endif // REGALLOC_HPP
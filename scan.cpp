@@ -0,0 +1,184 @@
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define F4_HAVE_X86_SIMD 1
+#endif
+
+static inline bool isSpaceByte(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// --- Scalar reference kernels ---
+
+static const char* skipSpaceScalar(const char* p, const char* end) {
+    while (p < end && isSpaceByte(*p)) p++;
+    return p;
+}
+
+static const char* findCommentEndScalar(const char* p, const char* end) {
+    for (; p + 1 < end; ++p) {
+        if (p[0] == '*' && p[1] == '/') return p;
+    }
+    return end;
+}
+
+static const char* findQuoteOrEscapeScalar(const char* p, const char* end) {
+    while (p < end && *p != '"' && *p != '\\') p++;
+    return p;
+}
+
+static void collectLineStartsScalar(const char* begin, const char* end, vector<uint32_t>& starts) {
+    for (const char* p = begin; p < end; ++p) {
+        if (*p == '\n') starts.push_back(static_cast<uint32_t>(p + 1 - begin));
+    }
+}
+
+static const ScanKernels scalarKernels = {
+    "scalar", skipSpaceScalar, findCommentEndScalar, findQuoteOrEscapeScalar, collectLineStartsScalar
+};
+
+#ifdef F4_HAVE_X86_SIMD
+
+// --- SSE2 kernels (16 bytes per step) ---
+// Whitespace is ' ' or a byte in [\t, \r]; signed compares keep bytes
+// >= 0x80 out of that range.
+
+__attribute__((target("sse2")))
+static const char* skipSpaceSSE2(const char* p, const char* end) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i below = _mm_set1_epi8('\t' - 1);
+    const __m128i above = _mm_set1_epi8('\r' + 1);
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                  _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above)));
+        unsigned mask = ~_mm_movemask_epi8(ws) & 0xFFFF;
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return skipSpaceScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* findCommentEndSSE2(const char* p, const char* end) {
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+    for (; p + 17 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v, star), _mm_cmpeq_epi8(next, slash)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return findCommentEndScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* findQuoteOrEscapeSSE2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return findQuoteOrEscapeScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static void collectLineStartsSSE2(const char* begin, const char* end, vector<uint32_t>& starts) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+        uint32_t base = static_cast<uint32_t>(p + 1 - begin);
+        for (; mask; mask &= mask - 1) starts.push_back(base + __builtin_ctz(mask));
+    }
+    for (; p < end; ++p) {
+        if (*p == '\n') starts.push_back(static_cast<uint32_t>(p + 1 - begin));
+    }
+}
+
+static const ScanKernels sse2Kernels = {
+    "sse2", skipSpaceSSE2, findCommentEndSSE2, findQuoteOrEscapeSSE2, collectLineStartsSSE2
+};
+
+// --- AVX2 kernels (32 bytes per step) ---
+
+__attribute__((target("avx2")))
+static const char* skipSpaceAVX2(const char* p, const char* end) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i below = _mm256_set1_epi8('\t' - 1);
+    const __m256i above = _mm256_set1_epi8('\r' + 1);
+    for (; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                     _mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v)));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ws));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return skipSpaceSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* findCommentEndAVX2(const char* p, const char* end) {
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+    for (; p + 33 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(v, star), _mm256_cmpeq_epi8(next, slash))));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return findCommentEndSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* findQuoteOrEscapeAVX2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    for (; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash))));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return findQuoteOrEscapeSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static void collectLineStartsAVX2(const char* begin, const char* end, vector<uint32_t>& starts) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const char* p = begin;
+    for (; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+        uint32_t base = static_cast<uint32_t>(p + 1 - begin);
+        for (; mask; mask &= mask - 1) starts.push_back(base + __builtin_ctz(mask));
+    }
+    for (; p < end; ++p) {
+        if (*p == '\n') starts.push_back(static_cast<uint32_t>(p + 1 - begin));
+    }
+}
+
+static const ScanKernels avx2Kernels = {
+    "avx2", skipSpaceAVX2, findCommentEndAVX2, findQuoteOrEscapeAVX2, collectLineStartsAVX2
+};
+
+#endif // F4_HAVE_X86_SIMD
+
+vector<const ScanKernels*> availableScanKernels() {
+    vector<const ScanKernels*> kernels = {&scalarKernels};
+#ifdef F4_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) kernels.push_back(&sse2Kernels);
+    if (__builtin_cpu_supports("avx2")) kernels.push_back(&avx2Kernels);
+#endif
+    return kernels;
+}
+
+const ScanKernels& scanKernels() {
+    static const ScanKernels& best = *availableScanKernels().back();
+    return best;
+}
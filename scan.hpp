@@ -0,0 +1,27 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// Byte-scanning kernels behind the lexer's hot loops. The find/skip kernels
+// return a pointer to the first matching byte in [p, end), or end if none.
+struct ScanKernels {
+    const char* name;
+    // First byte that is not ' ', \t, \n, \v, \f or \r
+    const char* (*skipSpace)(const char* p, const char* end);
+    // The '*' of the first "*/"
+    const char* (*findCommentEnd)(const char* p, const char* end);
+    // First '"' or '\\'
+    const char* (*findQuoteOrEscape)(const char* p, const char* end);
+    // Appends the offset (from begin) just past every '\n' in [begin, end)
+    void (*collectLineStarts)(const char* begin, const char* end, vector<uint32_t>& starts);
+};
+
+// Fastest kernels this CPU supports, selected once at first use
+const ScanKernels& scanKernels();
+// Every kernel set this CPU can run, scalar first; used for benchmarking
+vector<const ScanKernels*> availableScanKernels();
+
+#endif // SCAN_HPP
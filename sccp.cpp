@@ -0,0 +1,218 @@
+#include "optimizer.hpp"
+#include "ssa.hpp"
+#include <algorithm>
+
+// Undefined: no definition reached yet. Varying: more than one value.
+enum class Lattice : uint8_t { Undefined, Constant, Varying };
+
+struct LatticeValue {
+    Lattice state = Lattice::Undefined;
+    int32_t value = 0;
+};
+
+static size_t countQuads(const ControlFlowGraph& cfg) {
+    size_t count = 0;
+    for (const BasicBlock& block : cfg.blocks) count += block.code.size();
+    return count;
+}
+
+size_t propagateConstants(const IRModule& module, IRFunction& function, ControlFlowGraph& cfg) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    SSAValues values;
+    values.build(module, function, cfg);
+    vector<LatticeValue> lattice(values.count);
+
+    // Def-use chains. A use is (block, position), where positions below the
+    // block's phi count are phis and the rest index its code.
+    struct Use {
+        uint32_t block;
+        uint32_t position;
+    };
+    vector<uint32_t> useStart(values.count + 1);
+    vector<Use> uses;
+    auto forEachUse = [&](auto&& visit) {
+        for (uint32_t b = 0; b < blocks.size(); ++b) {
+            uint32_t position = 0;
+            for (const Phi& phi : blocks[b].phis) {
+                for (const Operand& arg : phi.args) visit(values.index(arg), b, position);
+                position++;
+            }
+            for (const Quad& quad : blocks[b].code) {
+                visit(values.index(quad.a), b, position);
+                visit(values.index(quad.b), b, position);
+                position++;
+            }
+        }
+    };
+    forEachUse([&](uint32_t index, uint32_t, uint32_t) {
+        if (index != noValue) useStart[index + 1]++;
+    });
+    for (size_t i = 1; i < useStart.size(); ++i) useStart[i] += useStart[i - 1];
+    uses.resize(useStart.back());
+    vector<uint32_t> fill(useStart.begin(), useStart.end() - 1);
+    forEachUse([&](uint32_t index, uint32_t b, uint32_t position) {
+        if (index != noValue) uses[fill[index]++] = {b, position};
+    });
+
+    // One flag per incoming edge, indexed through the target's pred slots
+    vector<uint32_t> edgeBase(blocks.size() + 1);
+    for (size_t b = 0; b < blocks.size(); ++b) edgeBase[b + 1] = edgeBase[b] + blocks[b].preds.size();
+    vector<bool> edgeExecutable(edgeBase.back());
+    vector<bool> blockExecutable(blocks.size());
+    auto edgeIndex = [&](uint32_t from, uint32_t to) {
+        const vector<uint32_t>& preds = blocks[to].preds;
+        return edgeBase[to] + (find(preds.begin(), preds.end(), from) - preds.begin());
+    };
+
+    vector<uint32_t> flowWork; // blocks reached by a newly executable edge
+    vector<uint32_t> ssaWork;  // values whose lattice value dropped
+    auto valueOf = [&](Operand operand) -> LatticeValue {
+        if (operand.kind == OperandKind::Const) return {Lattice::Constant, operand.value};
+        uint32_t index = values.index(operand);
+        if (index == noValue) return {Lattice::Varying, 0};
+        return lattice[index];
+    };
+    auto update = [&](Operand dst, LatticeValue value) {
+        uint32_t index = values.index(dst);
+        if (index == noValue || value.state == Lattice::Undefined) return;
+        LatticeValue& current = lattice[index];
+        if (current.state == Lattice::Varying) return;
+        if (current.state == Lattice::Constant) {
+            if (value.state == Lattice::Constant && value.value == current.value) return;
+            value = {Lattice::Varying, 0};
+        }
+        current = value;
+        ssaWork.push_back(index);
+    };
+    auto markEdge = [&](uint32_t from, uint32_t to) {
+        uint32_t edge = edgeIndex(from, to);
+        if (edgeExecutable[edge]) return;
+        edgeExecutable[edge] = true;
+        flowWork.push_back(to);
+    };
+    auto visitPhi = [&](uint32_t b, const Phi& phi) {
+        LatticeValue result;
+        for (size_t slot = 0; slot < phi.args.size(); ++slot) {
+            if (!edgeExecutable[edgeBase[b] + slot]) continue;
+            LatticeValue value = valueOf(phi.args[slot]);
+            if (value.state == Lattice::Undefined) continue;
+            if (result.state == Lattice::Undefined) {
+                result = value;
+            } else if (value.state == Lattice::Varying || value.value != result.value) {
+                result = {Lattice::Varying, 0};
+            }
+        }
+        update(phi.dst, result);
+    };
+    auto visitQuad = [&](uint32_t b, const Quad& quad) {
+        const BasicBlock& block = blocks[b];
+        switch (quad.op) {
+        case Opcode::Copy:
+            update(quad.dst, valueOf(quad.a));
+            break;
+        case Opcode::Call:
+            update(quad.dst, {Lattice::Varying, 0});
+            break;
+        case Opcode::IfNot: {
+            LatticeValue condition = valueOf(quad.a);
+            if (condition.state == Lattice::Undefined) break;
+            bool varying = condition.state == Lattice::Varying;
+            if (varying || condition.value != 0) markEdge(b, block.succs[0]);
+            if (varying || condition.value == 0) markEdge(b, block.succs[1]);
+            break;
+        }
+        case Opcode::Goto:
+            markEdge(b, block.succs[0]);
+            break;
+        case Opcode::Param:
+        case Opcode::Return:
+        case Opcode::Label:
+            break;
+        default: {
+            LatticeValue left = valueOf(quad.a), right = valueOf(quad.b);
+            if (left.state == Lattice::Varying || right.state == Lattice::Varying) {
+                update(quad.dst, {Lattice::Varying, 0});
+            } else if (left.state == Lattice::Constant && right.state == Lattice::Constant) {
+                int32_t result;
+                if (evaluateBinary(quad.op, left.value, right.value, result)) {
+                    update(quad.dst, {Lattice::Constant, result});
+                } else {
+                    // Left for the program to trap on at run time
+                    update(quad.dst, {Lattice::Varying, 0});
+                }
+            }
+            break;
+        }
+        }
+    };
+    auto visitBlock = [&](uint32_t b) {
+        BasicBlock& block = blocks[b];
+        for (const Phi& phi : block.phis) visitPhi(b, phi);
+        if (blockExecutable[b]) return;
+        blockExecutable[b] = true;
+        for (const Quad& quad : block.code) visitQuad(b, quad);
+        bool branches = !block.code.empty() && block.code.back().op == Opcode::IfNot;
+        if (block.fallsThrough() && !branches && !block.succs.empty()) markEdge(b, block.succs[0]);
+    };
+
+    visitBlock(0);
+    while (!flowWork.empty() || !ssaWork.empty()) {
+        if (!flowWork.empty()) {
+            uint32_t b = flowWork.back();
+            flowWork.pop_back();
+            visitBlock(b);
+            continue;
+        }
+        uint32_t index = ssaWork.back();
+        ssaWork.pop_back();
+        for (uint32_t i = useStart[index]; i < useStart[index + 1]; ++i) {
+            const Use& use = uses[i];
+            if (!blockExecutable[use.block]) continue;
+            const BasicBlock& block = blocks[use.block];
+            if (use.position < block.phis.size()) visitPhi(use.block, block.phis[use.position]);
+            else visitQuad(use.block, block.code[use.position - block.phis.size()]);
+        }
+    }
+
+    // Rewrite: constants replace their uses, their definitions go, and
+    // branches keep only the edges that can be taken
+    size_t before = countQuads(cfg);
+    auto isConstant = [&](Operand operand) {
+        uint32_t index = values.index(operand);
+        return index != noValue && lattice[index].state == Lattice::Constant;
+    };
+    auto substitute = [&](Operand& operand) {
+        if (isConstant(operand)) operand = Operand::constant(lattice[values.index(operand)].value);
+    };
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        if (!blockExecutable[b]) continue;
+        BasicBlock& block = blocks[b];
+        block.phis.erase(remove_if(block.phis.begin(), block.phis.end(),
+                                   [&](const Phi& phi) { return isConstant(phi.dst); }),
+                         block.phis.end());
+        for (Phi& phi : block.phis) {
+            for (Operand& arg : phi.args) substitute(arg);
+        }
+        block.code.erase(remove_if(block.code.begin(), block.code.end(),
+                                   [&](const Quad& quad) { return isConstant(quad.dst); }),
+                         block.code.end());
+        for (Quad& quad : block.code) {
+            substitute(quad.a);
+            substitute(quad.b);
+        }
+        if (!block.code.empty() && block.code.back().op == Opcode::IfNot) {
+            uint32_t next = block.succs[0], target = block.succs[1];
+            bool toNext = edgeExecutable[edgeIndex(b, next)];
+            bool toTarget = edgeExecutable[edgeIndex(b, target)];
+            if (toNext && !toTarget) {
+                block.code.pop_back();
+                removeEdge(cfg, b, target);
+            } else if (toTarget && !toNext) {
+                block.code.back() = {Opcode::Goto, {}, blocks[target].label, {}};
+                removeEdge(cfg, b, next);
+            }
+        }
+    }
+    removeUnreachableBlocks(cfg);
+    return before - countQuads(cfg);
+}
@@ -3,67 +3,58 @@
 // Helper to check if a block contains a return statement
 bool hasReturnStatement(ASTNode* node) {
     if (!node) return false;
-    if (node->nodeType == "Return") return true;
-    for (const auto& child : node->children) {
-        if (hasReturnStatement(child.get())) return true;
+    vector<ASTNode*> stack = {node};
+    while (!stack.empty()) {
+        ASTNode* current = stack.back();
+        stack.pop_back();
+        if (current->kind == NodeKind::Return) return true;
+        for (ASTNode* child = current->firstChild; child; child = child->next) {
+            stack.push_back(child);
+        }
     }
     return false;
 }
 
-void semanticAnalysis(ASTNode* node, map<string, string>& symbolTable, vector<string>& errors) {
+// Checks run in pre-order (a declaration is recorded before its initializer
+// is checked). The walk is iterative: visiting a node pushes its next
+// sibling and then its first child, so a subtree is finished before the
+// sibling that follows it.
+void semanticAnalysis(ASTNode* node, SymbolTable& symbolTable, vector<string>& errors) {
     if (!node) return;
-    if (node->nodeType == "Program") {
-        for (const auto& child : node->children) {
-            semanticAnalysis(child.get(), symbolTable, errors);
-        }
-    } else if (node->nodeType == "FunctionDecl") {
-        // Check if int function has return statement
-        bool hasReturn = hasReturnStatement(node);
-        if (!hasReturn) {
-            errors.push_back("Function '" + node->value + "' with return type 'int' must have a return statement.");
-        }
-        // Analyze function body
-        for (const auto& child : node->children) {
-            semanticAnalysis(child.get(), symbolTable, errors);
-        }
-    } else if (node->nodeType == "Block") {
-        for (const auto& child : node->children) {
-            semanticAnalysis(child.get(), symbolTable, errors);
-        }
-    } else if (node->nodeType == "Declaration") {
-        if (symbolTable.find(node->value) != symbolTable.end()) {
-            errors.push_back("Variable '" + node->value + "' already declared.");
-        } else {
-            symbolTable[node->value] = "int";
-        }
-        if (!node->children.empty()) {
-            semanticAnalysis(node->children[0].get(), symbolTable, errors);
-        }
-    } else if (node->nodeType == "Assignment") {
-        if (symbolTable.find(node->value) == symbolTable.end()) {
-            errors.push_back("Undeclared variable '" + node->value + "' in assignment.");
-        }
-        if (!node->children.empty()) {
-            semanticAnalysis(node->children[0].get(), symbolTable, errors);
-        }
-    } else if (node->nodeType == "Identifier") {
-        if (symbolTable.find(node->value) == symbolTable.end()) {
-            errors.push_back("Undeclared variable '" + node->value + "'.");
-        }
-    } else if (node->nodeType == "BinaryExpr") {
-        semanticAnalysis(node->children[0].get(), symbolTable, errors);
-        semanticAnalysis(node->children[1].get(), symbolTable, errors);
-    } else if (node->nodeType == "Return") {
-        if (!node->children.empty())
-            semanticAnalysis(node->children[0].get(), symbolTable, errors);
-    } else if (node->nodeType == "IfElse") {
-        for (const auto& child : node->children) {
-            semanticAnalysis(child.get(), symbolTable, errors);
-        }
-    } else if (node->nodeType == "FunctionCall") {
-        // Basic check: just analyze arguments
-        for (const auto& child : node->children) {
-            semanticAnalysis(child.get(), symbolTable, errors);
+    vector<ASTNode*> stack = {node};
+    while (!stack.empty()) {
+        ASTNode* current = stack.back();
+        stack.pop_back();
+        if (current != node && current->next) stack.push_back(current->next);
+        if (current->firstChild) stack.push_back(current->firstChild);
+        switch (current->kind) {
+        case NodeKind::FunctionDecl:
+            // Check if int function has return statement
+            if (!hasReturnStatement(current)) {
+                errors.push_back("Function '" + string(current->value) + "' with return type 'int' must have a return statement.");
+            }
+            break;
+        case NodeKind::Declaration:
+            if (symbolTable.find(current->value) != symbolTable.end()) {
+                errors.push_back("Variable '" + string(current->value) + "' already declared.");
+            } else {
+                symbolTable.emplace(current->value, "int");
+            }
+            break;
+        case NodeKind::Assignment:
+            if (symbolTable.find(current->value) == symbolTable.end()) {
+                errors.push_back("Undeclared variable '" + string(current->value) + "' in assignment.");
+            }
+            break;
+        case NodeKind::Identifier:
+            if (symbolTable.find(current->value) == symbolTable.end()) {
+                errors.push_back("Undeclared variable '" + string(current->value) + "'.");
+            }
+            break;
+        default:
+            // Program, Block, BinaryExpr, IfElse, Return, FunctionCall and
+            // literals only need their children analyzed
+            break;
         }
     }
-}
\ No newline at end of file
+}
@@ -7,6 +7,9 @@
 #include "parser.hpp"
 using namespace std;
 
-void semanticAnalysis(ASTNode* node, map<string, string>& symbolTable, vector<string>& errors);
+// Variable name -> type; less<> lets lookups use the AST's string_views
+using SymbolTable = map<string, string, less<>>;
 
-#endif // SEMANTIC_HPP 
\ No newline at end of file
+void semanticAnalysis(ASTNode* node, SymbolTable& symbolTable, vector<string>& errors);
+
+#endif // SEMANTIC_HPP
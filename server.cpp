@@ -0,0 +1,211 @@
+#include "server.hpp"
+#include "threadpool.hpp"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static uint32_t getLE(const uint8_t* bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+static void putLE(uint8_t* bytes, uint32_t value) {
+    for (int i = 0; i < 4; ++i) bytes[i] = static_cast<uint8_t>(value >> 8 * i);
+}
+
+// False at end of input, clean or not
+static bool readFull(int fd, void* buffer, size_t size) {
+    char* at = static_cast<char*>(buffer);
+    while (size) {
+        ssize_t count = read(fd, at, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        at += count;
+        size -= count;
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const void* buffer, size_t size) {
+    const char* at = static_cast<const char*>(buffer);
+    while (size) {
+        ssize_t count = write(fd, at, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        at += count;
+        size -= count;
+    }
+    return true;
+}
+
+// One client: requests are read from in, and responses, which workers
+// finish in any order, are written whole to out one at a time
+struct Connection {
+    int in;
+    int out;
+    bool owned; // a socket, closed once the last response is out
+    mutex writing;
+
+    ~Connection() {
+        if (owned) close(in);
+    }
+};
+
+// Caps the requests read but not yet answered, so that a client sending
+// faster than the pool compiles waits instead of growing the queue
+struct Backlog {
+    mutex lock;
+    condition_variable available;
+    size_t inFlight = 0;
+    size_t limit;
+
+    explicit Backlog(size_t limit) : limit(limit) {}
+
+    void acquire() {
+        unique_lock<mutex> guard(lock);
+        available.wait(guard, [this] { return inFlight < limit; });
+        inFlight++;
+    }
+
+    void release() {
+        {
+            lock_guard<mutex> guard(lock);
+            inFlight--;
+        }
+        available.notify_one();
+    }
+};
+
+static void respond(Connection& connection, uint32_t id, const CompileOptions& defaults, const string& payload) {
+    // The options line, then the source
+    size_t newline = payload.find('\n');
+    string_view line(payload.data(), newline == string::npos ? payload.size() : newline);
+    string_view source = newline == string::npos ? string_view() : string_view(payload).substr(newline + 1);
+
+    CompileOptions options = pooledOptions(defaults);
+    ostringstream report;
+    int status = 0;
+    while (!line.empty()) {
+        size_t space = line.find(' ');
+        string_view option = line.substr(0, space);
+        line = space == string_view::npos ? string_view() : line.substr(space + 1);
+        if (!option.empty() && !applyOption(option, options)) {
+            report << "Error: Unknown option '" << option << "'" << endl;
+            status = 1;
+        }
+    }
+    string reason;
+    if (status == 0 && !checkOptions(options, reason)) {
+        report << "Error: " << reason << endl;
+        status = 1;
+    }
+    if (status == 0 && options.run) {
+        report << "Error: --run is not available with --serve" << endl;
+        status = 1;
+    }
+    if (status == 0) status = compile(source, options, report);
+
+    string text = report.str();
+    uint8_t header[12];
+    putLE(header, id);
+    putLE(header + 4, static_cast<uint32_t>(status));
+    putLE(header + 8, static_cast<uint32_t>(text.size()));
+    lock_guard<mutex> guard(connection.writing);
+    // A client that went away just loses its responses
+    if (writeFull(connection.out, header, sizeof(header))) writeFull(connection.out, text.data(), text.size());
+}
+
+// Reads requests until the connection ends and hands them to the pool.
+// False when a request was malformed.
+static bool readRequests(shared_ptr<Connection> connection, const CompileOptions& defaults, ThreadPool& pool,
+                         Backlog& backlog) {
+    uint8_t header[8];
+    while (readFull(connection->in, header, sizeof(header))) {
+        uint32_t id = getLE(header);
+        uint32_t size = getLE(header + 4);
+        if (size > maxRequestSize) {
+            cerr << "Error: Request " << id << " is " << size << " bytes, over the limit of " << maxRequestSize
+                 << endl;
+            return false;
+        }
+        string payload(size, '\0');
+        if (!readFull(connection->in, &payload[0], size)) {
+            cerr << "Error: Request " << id << " ends early" << endl;
+            return false;
+        }
+        backlog.acquire();
+        pool.submit([connection, id, &defaults, &backlog, payload = move(payload)] {
+            respond(*connection, id, defaults, payload);
+            backlog.release();
+        });
+    }
+    return true;
+}
+
+int serve(const char* socketPath, const CompileOptions& defaults) {
+    // Writing to a client that has gone must not end the server
+    signal(SIGPIPE, SIG_IGN);
+    ThreadPool pool;
+    Backlog backlog(4 * pool.size());
+
+    if (!socketPath) {
+        auto connection = make_shared<Connection>();
+        connection->in = STDIN_FILENO;
+        connection->out = STDOUT_FILENO;
+        connection->owned = false;
+        bool wellFormed = readRequests(connection, defaults, pool, backlog);
+        pool.wait();
+        return wellFormed ? 0 : 1;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        cerr << "Error: Socket path '" << socketPath << "' is too long" << endl;
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+    struct stat existing;
+    if (lstat(socketPath, &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(socketPath);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        cerr << "Error: Could not listen on '" << socketPath << "': " << strerror(errno) << endl;
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+    // Each connection has a reader of its own, all feeding the one pool
+    for (;;) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // Out of descriptors: the pending connection keeps the listener
+            // readable, so retrying at once would spin. Give the connections
+            // being served time to close and free some.
+            if (errno == EMFILE || errno == ENFILE) {
+                this_thread::sleep_for(chrono::milliseconds(100));
+                continue;
+            }
+            cerr << "Error: Could not accept a connection: " << strerror(errno) << endl;
+            // Readers may still be handing requests to the pool: leave
+            // without tearing it down under them
+            _exit(1);
+        }
+        auto connection = make_shared<Connection>();
+        connection->in = client;
+        connection->out = client;
+        connection->owned = true;
+        thread([connection, &defaults, &pool, &backlog] {
+            readRequests(connection, defaults, pool, backlog);
+        }).detach();
+    }
+}
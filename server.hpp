@@ -0,0 +1,29 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <cstdint>
+#include "pipeline.hpp"
+using namespace std;
+
+// Compile requests are framed by little-endian 32-bit fields:
+//
+//   request:  id, size, then size bytes: a line of options (-O, -m64,
+//             --interpret, --emit; may be empty) and the source after it
+//   response: id, status, size, then size bytes: the report compile()
+//             writes, status being its exit status
+//
+// Requests run concurrently, so responses come back in the order they
+// finish and carry the id of their request. An unknown option fails its
+// request with status 1 and an error as the report, as does --run: it
+// forks, which is not safe from the pool's threads.
+const uint32_t maxRequestSize = 64 * 1024 * 1024;
+
+// Serves requests with defaults as the options every request starts
+// from, on a pool sized to the machine. With no socket path the requests
+// come on stdin and the responses go to stdout, until stdin ends;
+// otherwise it listens on a Unix domain socket at that path, replacing
+// a stale socket there, and serves each connection until it closes.
+// Returns the exit status.
+int serve(const char* socketPath, const CompileOptions& defaults);
+
+#endif // SERVER_HPP
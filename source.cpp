@@ -0,0 +1,43 @@
+#include "source.hpp"
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define F4_HAVE_MMAP 1
+#endif
+
+SourceFile::~SourceFile() {
+#ifdef F4_HAVE_MMAP
+    if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+}
+
+bool SourceFile::open(const string& path) {
+#ifdef F4_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            close(fd);
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(addr);
+            size = st.st_size;
+            mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) return false;
+    buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Read-only view of a source file. Regular files are memory-mapped so the
+// lexer works straight from the page cache; anything that cannot be mapped
+// (pipes, empty files, non-POSIX hosts) is read into an owned buffer.
+struct SourceFile {
+    SourceFile() = default;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    ~SourceFile();
+
+    bool open(const string& path);
+    string_view text() const { return string_view(data, size); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    string buffer;
+};
+
+#endif // SOURCE_HPP
@@ -0,0 +1,147 @@
+#include "ssa.hpp"
+#include <algorithm>
+
+void constructSSA(const IRModule& module, ControlFlowGraph& cfg) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    size_t varCount = module.vars.size();
+
+    // Variables read in a block before being written there are live across
+    // blocks; only those can need a phi
+    vector<bool> crossesBlocks(varCount);
+    vector<vector<uint32_t>> defBlocks(varCount);
+    vector<uint32_t> definedIn(varCount, noBlock);
+    for (uint32_t b : cfg.rpo) {
+        for (const Quad& quad : blocks[b].code) {
+            for (const Operand* use : {&quad.a, &quad.b}) {
+                if (use->kind == OperandKind::Var && definedIn[use->id()] != b) crossesBlocks[use->id()] = true;
+            }
+            if (quad.dst.kind == OperandKind::Var && definedIn[quad.dst.id()] != b) {
+                definedIn[quad.dst.id()] = b;
+                defBlocks[quad.dst.id()].push_back(b);
+            }
+        }
+    }
+
+    // Phis go on the iterated dominance frontier of each variable's
+    // definitions
+    vector<vector<uint32_t>> frontiers;
+    dominanceFrontiers(cfg, frontiers);
+    vector<uint32_t> hasPhi(blocks.size(), noBlock);
+    vector<uint32_t> queued(blocks.size(), noBlock);
+    vector<uint32_t> work;
+    for (uint32_t v = 0; v < varCount; ++v) {
+        if (!crossesBlocks[v]) continue;
+        work = defBlocks[v];
+        for (uint32_t b : work) queued[b] = v;
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t f : frontiers[b]) {
+                if (hasPhi[f] == v) continue;
+                hasPhi[f] = v;
+                blocks[f].phis.push_back({Operand::var(v), vector<Operand>(blocks[f].preds.size(), Operand::var(v))});
+                if (queued[f] != v) {
+                    queued[f] = v;
+                    work.push_back(f);
+                }
+            }
+        }
+    }
+
+    // Rename along the dominator tree, keeping a stack of live versions per
+    // variable
+    struct Frame {
+        uint32_t block;
+        uint32_t nextChild;
+        size_t definedMark;
+    };
+    vector<vector<uint32_t>> current(varCount);
+    vector<uint32_t> nextVersion(varCount, 1);
+    vector<uint32_t> defined; // variables in the order their versions were pushed
+    vector<Frame> stack;
+    auto top = [&](uint32_t v) { return current[v].empty() ? 0 : current[v].back(); };
+    auto define = [&](Operand& dst) {
+        dst.version = nextVersion[dst.id()]++;
+        current[dst.id()].push_back(dst.version);
+        defined.push_back(dst.id());
+    };
+    auto enter = [&](uint32_t b) {
+        stack.push_back({b, 0, defined.size()});
+        BasicBlock& block = blocks[b];
+        for (Phi& phi : block.phis) define(phi.dst);
+        for (Quad& quad : block.code) {
+            if (quad.a.kind == OperandKind::Var) quad.a.version = top(quad.a.id());
+            if (quad.b.kind == OperandKind::Var) quad.b.version = top(quad.b.id());
+            if (quad.dst.kind == OperandKind::Var) define(quad.dst);
+        }
+        for (uint32_t s : block.succs) {
+            BasicBlock& succ = blocks[s];
+            size_t slot = find(succ.preds.begin(), succ.preds.end(), b) - succ.preds.begin();
+            for (Phi& phi : succ.phis) phi.args[slot].version = top(phi.args[slot].id());
+        }
+    };
+    enter(0);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.nextChild < blocks[frame.block].children.size()) {
+            enter(blocks[frame.block].children[frame.nextChild++]);
+            continue;
+        }
+        for (; defined.size() > frame.definedMark; defined.pop_back()) current[defined.back()].pop_back();
+        stack.pop_back();
+    }
+}
+
+void destructSSA(IRFunction& function, ControlFlowGraph& cfg) {
+    vector<Quad> copies;
+    for (uint32_t b = 0; b < cfg.blocks.size(); ++b) {
+        if (cfg.blocks[b].phis.empty()) continue;
+        for (size_t slot = 0; slot < cfg.blocks[b].preds.size(); ++slot) {
+            copies.clear();
+            for (const Phi& phi : cfg.blocks[b].phis) {
+                const Operand& arg = phi.args[slot];
+                // Another version of the same variable needs no copy
+                if (arg.kind == OperandKind::Var && arg.id() == phi.dst.id()) continue;
+                copies.push_back({Opcode::Copy, phi.dst, arg, {}});
+            }
+            if (copies.empty()) continue;
+            uint32_t pred = cfg.blocks[b].preds[slot];
+            if (cfg.blocks[pred].succs.size() > 1) pred = splitEdge(function, cfg, pred, b);
+            vector<Quad>& code = cfg.blocks[pred].code;
+            auto at = !code.empty() && code.back().op == Opcode::Goto ? code.end() - 1 : code.end();
+            code.insert(at, copies.begin(), copies.end());
+        }
+        cfg.blocks[b].phis.clear();
+    }
+    for (BasicBlock& block : cfg.blocks) {
+        for (Quad& quad : block.code) {
+            quad.dst.version = 0;
+            quad.a.version = 0;
+            quad.b.version = 0;
+        }
+    }
+}
+
+void SSAValues::build(const IRModule& module, const IRFunction& function, const ControlFlowGraph& cfg) {
+    tempCount = function.tempCount;
+    vector<uint32_t> versions(module.vars.size());
+    auto note = [&](Operand dst) {
+        if (dst.kind == OperandKind::Var) versions[dst.id()] = max(versions[dst.id()], dst.version);
+    };
+    for (const BasicBlock& block : cfg.blocks) {
+        for (const Phi& phi : block.phis) note(phi.dst);
+        for (const Quad& quad : block.code) note(quad.dst);
+    }
+    varBase.resize(versions.size());
+    count = tempCount;
+    for (size_t v = 0; v < versions.size(); ++v) {
+        varBase[v] = count;
+        count += versions[v];
+    }
+}
+
+uint32_t SSAValues::index(Operand operand) const {
+    if (operand.kind == OperandKind::Temp) return operand.id();
+    if (operand.kind == OperandKind::Var && operand.version) return varBase[operand.id()] + operand.version - 1;
+    return noValue;
+}
@@ -0,0 +1,34 @@
+#ifndef SSA_HPP
+#define SSA_HPP
+
+#include "cfg.hpp"
+#include "ir.hpp"
+
+// Renames every variable definition to a fresh version and places phis
+// where versions meet, only for variables that are live across blocks.
+// Version 0 stands for a variable's value on entry. Temporaries are
+// already assigned once and are left alone.
+//
+// Passes working on SSA form may replace a variable use with a constant or
+// a temporary, but never with another variable: keeping the versions of
+// each variable free of overlap is what lets destructSSA() simply drop
+// them.
+void constructSSA(const IRModule& module, ControlFlowGraph& cfg);
+// Replaces phis with copies at the end of their predecessors, splitting
+// critical edges where needed, and clears all versions
+void destructSSA(IRFunction& function, ControlFlowGraph& cfg);
+
+const uint32_t noValue = UINT32_MAX;
+
+// Dense numbering of the values of a function in SSA form: temporaries
+// first, then every version of every variable. Version 0 is not numbered.
+struct SSAValues {
+    uint32_t tempCount = 0;
+    vector<uint32_t> varBase; // number of version 1 of each variable
+    uint32_t count = 0;
+
+    void build(const IRModule& module, const IRFunction& function, const ControlFlowGraph& cfg);
+    uint32_t index(Operand operand) const;
+};
+
+#endif // SSA_HPP
@@ -0,0 +1,122 @@
+#include "threadpool.hpp"
+#include <cstdint>
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([this] { run(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<mutex> guard(lock);
+        queue.push_back(move(task));
+        pending++;
+    }
+    ready.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [this] { return pending == 0; });
+}
+
+void ThreadPool::run() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> guard(lock);
+            ready.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            task = move(queue.front());
+            queue.pop_front();
+        }
+        task();
+        {
+            lock_guard<mutex> guard(lock);
+            if (--pending == 0) idle.notify_all();
+        }
+    }
+}
+
+// The indices [begin, end) a thread has yet to run, on a cache line of
+// its own
+struct alignas(64) Share {
+    mutex lock;
+    size_t begin = 0;
+    size_t end = 0;
+
+    size_t left() {
+        lock_guard<mutex> guard(lock);
+        return end - begin;
+    }
+};
+
+static bool steal(vector<Share>& shares, Share& mine) {
+    for (;;) {
+        Share* victim = nullptr;
+        size_t most = 0;
+        for (Share& share : shares) {
+            size_t left = share.left();
+            if (left > most) {
+                most = left;
+                victim = &share;
+            }
+        }
+        if (!victim) return false;
+        size_t begin, end;
+        {
+            lock_guard<mutex> guard(victim->lock);
+            // Its owner may have run it down in the meantime
+            if (victim->begin == victim->end) continue;
+            end = victim->end;
+            begin = victim->begin + (victim->end - victim->begin) / 2;
+            victim->end = begin;
+        }
+        lock_guard<mutex> guard(mine.lock);
+        mine.begin = begin;
+        mine.end = end;
+        return true;
+    }
+}
+
+void parallelFor(size_t count, unsigned threads, const function<void(size_t)>& body) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > count) threads = static_cast<unsigned>(count);
+    if (threads == 0) return;
+    vector<Share> shares(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        shares[i].begin = count * i / threads;
+        shares[i].end = count * (i + 1) / threads;
+    }
+    auto work = [&](unsigned self) {
+        Share& mine = shares[self];
+        for (;;) {
+            size_t index = SIZE_MAX;
+            {
+                lock_guard<mutex> guard(mine.lock);
+                if (mine.begin < mine.end) index = mine.begin++;
+            }
+            if (index != SIZE_MAX) body(index);
+            else if (!steal(shares, mine)) return;
+        }
+    };
+    vector<thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i) workers.emplace_back(work, i);
+    work(0);
+    for (auto& worker : workers) worker.join();
+}
@@ -0,0 +1,44 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed set of worker threads fed from a shared FIFO queue.
+struct ThreadPool {
+    // threads == 0 sizes the pool to the machine
+    explicit ThreadPool(unsigned threads = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    void submit(function<void()> task);
+    // Blocks until every submitted task has finished
+    void wait();
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+    void run();
+
+    vector<thread> workers;
+    deque<function<void()>> queue;
+    mutex lock;
+    condition_variable ready;
+    condition_variable idle;
+    size_t pending = 0;
+    bool stopping = false;
+};
+
+// Runs body(i) for every i below count on the given number of threads (0
+// sizes it to the machine), the calling thread among them. Each thread
+// starts on an equal share of the indices and, once through it, steals
+// the upper half of the largest share left, so that a few slow items do
+// not leave the other threads idle at the end.
+void parallelFor(size_t count, unsigned threads, const function<void(size_t)>& body);
+
+#endif // THREADPOOL_HPP
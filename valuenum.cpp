@@ -0,0 +1,137 @@
+#include "optimizer.hpp"
+#include "ssa.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+struct ExpressionKey {
+    Opcode op;
+    Operand a;
+    Operand b;
+    bool operator==(const ExpressionKey& other) const { return op == other.op && a == other.a && b == other.b; }
+};
+
+struct ExpressionKeyHash {
+    size_t operator()(const ExpressionKey& key) const {
+        auto mix = [](size_t h, uint64_t v) { return (h ^ v) * 0x100000001b3ull; };
+        size_t h = 0xcbf29ce484222325ull;
+        h = mix(h, static_cast<uint64_t>(key.op));
+        for (const Operand& operand : {key.a, key.b}) {
+            h = mix(h, static_cast<uint64_t>(operand.kind));
+            h = mix(h, static_cast<uint32_t>(operand.value));
+            h = mix(h, operand.version);
+        }
+        return h;
+    }
+};
+
+static bool operandLess(const Operand& x, const Operand& y) {
+    if (x.kind != y.kind) return x.kind < y.kind;
+    if (x.value != y.value) return x.value < y.value;
+    return x.version < y.version;
+}
+
+// Puts equivalent expressions in one form: commutative operands sorted,
+// a > b written as b < a
+static ExpressionKey canonical(Opcode op, Operand a, Operand b) {
+    switch (op) {
+    case Opcode::CmpGt: return {Opcode::CmpLt, b, a};
+    case Opcode::CmpGe: return {Opcode::CmpLe, b, a};
+    case Opcode::Add:
+    case Opcode::Mul:
+    case Opcode::CmpEq:
+    case Opcode::CmpNe:
+        if (operandLess(b, a)) swap(a, b);
+        return {op, a, b};
+    default:
+        return {op, a, b};
+    }
+}
+
+size_t numberValues(const IRModule& module, IRFunction& function, ControlFlowGraph& cfg) {
+    vector<BasicBlock>& blocks = cfg.blocks;
+    SSAValues values;
+    values.build(module, function, cfg);
+    // The temporary or constant each value is known to equal, if any.
+    // Variables never lead, so uses of one variable are not rewritten to
+    // another (see ssa.hpp).
+    vector<Operand> leader(values.count);
+    auto lookup = [&](Operand operand) {
+        uint32_t index = values.index(operand);
+        if (index == noValue || leader[index].isNone()) return operand;
+        return leader[index];
+    };
+    auto canLead = [](Operand operand) {
+        return operand.kind == OperandKind::Temp || operand.kind == OperandKind::Const;
+    };
+
+    // Expressions available in the current block, scoped to the dominator
+    // subtree that computed them
+    unordered_map<ExpressionKey, Operand, ExpressionKeyHash> available;
+    vector<ExpressionKey> added;
+    struct Frame {
+        uint32_t block;
+        uint32_t nextChild;
+        size_t addedMark;
+    };
+    vector<Frame> stack;
+    size_t removed = 0;
+
+    // Children are kept in reverse postorder, so every predecessor of a
+    // block has been visited, and has rewritten its phi arguments, first
+    auto enter = [&](uint32_t b) {
+        stack.push_back({b, 0, added.size()});
+        BasicBlock& block = blocks[b];
+        block.phis.erase(remove_if(block.phis.begin(), block.phis.end(),
+                                   [&](const Phi& phi) {
+                                       Operand first = phi.args.empty() ? Operand{} : phi.args[0];
+                                       if (!canLead(first)) return false;
+                                       for (const Operand& arg : phi.args) {
+                                           if (arg != first) return false;
+                                       }
+                                       leader[values.index(phi.dst)] = first;
+                                       return true;
+                                   }),
+                         block.phis.end());
+
+        size_t kept = 0;
+        for (size_t i = 0; i < block.code.size(); ++i) {
+            Quad quad = block.code[i];
+            quad.a = lookup(quad.a);
+            quad.b = lookup(quad.b);
+            if (quad.op == Opcode::Copy && canLead(quad.a)) {
+                leader[values.index(quad.dst)] = quad.a;
+            } else if (isBinary(quad.op)) {
+                ExpressionKey key = canonical(quad.op, quad.a, quad.b);
+                auto found = available.find(key);
+                if (found != available.end()) {
+                    leader[values.index(quad.dst)] = found->second;
+                    removed++;
+                    continue;
+                }
+                if (quad.dst.kind == OperandKind::Temp) {
+                    available.emplace(key, quad.dst);
+                    added.push_back(key);
+                }
+            }
+            block.code[kept++] = quad;
+        }
+        block.code.resize(kept);
+
+        for (uint32_t s : block.succs) {
+            BasicBlock& succ = blocks[s];
+            size_t slot = find(succ.preds.begin(), succ.preds.end(), b) - succ.preds.begin();
+            for (Phi& phi : succ.phis) phi.args[slot] = lookup(phi.args[slot]);
+        }
+    };
+    enter(0);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.nextChild < blocks[frame.block].children.size()) {
+            enter(blocks[frame.block].children[frame.nextChild++]);
+            continue;
+        }
+        for (; added.size() > frame.addedMark; added.pop_back()) available.erase(added.back());
+        stack.pop_back();
+    }
+    return removed;
+}
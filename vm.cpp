@@ -0,0 +1,368 @@
+#include "vm.hpp"
+#include "encoder.hpp"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+// Register allocation for one function: each constant, string, variable
+// and temporary gets its own register on first use
+struct RegisterFile {
+    BytecodeFunction& function;
+    const vector<uint32_t>& stringAddresses;
+    unordered_map<int32_t, uint16_t> constants;
+    unordered_map<uint32_t, uint16_t> strings;
+    unordered_map<uint32_t, uint16_t> vars;
+    vector<uint32_t> temps;
+    bool overflow = false;
+
+    uint16_t add(int32_t initial) {
+        if (function.registers.size() > UINT16_MAX) overflow = true;
+        function.registers.push_back(initial);
+        return static_cast<uint16_t>(function.registers.size() - 1);
+    }
+
+    uint16_t operator()(Operand operand) {
+        switch (operand.kind) {
+        case OperandKind::Const: {
+            auto it = constants.find(operand.value);
+            return it != constants.end() ? it->second : constants[operand.value] = add(operand.value);
+        }
+        case OperandKind::String: {
+            auto it = strings.find(operand.id());
+            if (it != strings.end()) return it->second;
+            return strings[operand.id()] = add(stringBase + static_cast<int32_t>(stringAddresses[operand.id()]));
+        }
+        case OperandKind::Var: {
+            auto it = vars.find(operand.id());
+            return it != vars.end() ? it->second : vars[operand.id()] = add(0);
+        }
+        case OperandKind::Temp:
+            if (temps[operand.id()] == UINT32_MAX) temps[operand.id()] = add(0);
+            return static_cast<uint16_t>(temps[operand.id()]);
+        default:
+            // A call without a result writes a scratch register
+            return add(0);
+        }
+    }
+};
+
+static BOp arithmetic(Opcode op) {
+    switch (op) {
+    case Opcode::Add: return BOp::Add;
+    case Opcode::Sub: return BOp::Sub;
+    case Opcode::Mul: return BOp::Mul;
+    case Opcode::Div: return BOp::Div;
+    case Opcode::Mod: return BOp::Mod;
+    case Opcode::CmpEq: return BOp::Eq;
+    case Opcode::CmpNe: return BOp::Ne;
+    case Opcode::CmpLt: return BOp::Lt;
+    case Opcode::CmpLe: return BOp::Le;
+    case Opcode::CmpGt: return BOp::Gt;
+    default: return BOp::Ge;
+    }
+}
+
+static BOp jumpUnless(Opcode compare) {
+    return static_cast<BOp>(static_cast<int>(BOp::JumpUnlessEq) + static_cast<int>(compare) - static_cast<int>(Opcode::CmpEq));
+}
+
+static bool compileFunction(const IRModule& module, const IRFunction& function, const vector<uint32_t>& stringAddresses,
+                            BytecodeFunction& out, string& error) {
+    out.name = function.name;
+    RegisterFile reg{out, stringAddresses, {}, {}, {}, vector<uint32_t>(function.tempCount, UINT32_MAX)};
+    const vector<Quad>& code = function.code;
+
+    // A compare whose only reader is the ifnot right after it fuses with it
+    vector<uint32_t> reads(function.tempCount, 0);
+    for (const Quad& quad : code) {
+        for (Operand operand : {quad.a, quad.b}) {
+            if (operand.kind == OperandKind::Temp) reads[operand.id()]++;
+        }
+    }
+
+    vector<uint32_t> labelAt(function.labels.size(), 0);
+    vector<uint32_t> jumps; // instructions whose c is still a label
+    for (size_t i = 0; i < code.size(); ++i) {
+        const Quad& quad = code[i];
+        switch (quad.op) {
+        case Opcode::Copy: out.code.push_back({BOp::Move, reg(quad.dst), reg(quad.a)}); break;
+        case Opcode::Label: labelAt[quad.a.id()] = out.code.size(); break;
+        case Opcode::IfNot:
+            jumps.push_back(out.code.size());
+            out.code.push_back({BOp::JumpUnless, reg(quad.a), 0, static_cast<uint16_t>(quad.b.id())});
+            break;
+        case Opcode::Goto:
+            jumps.push_back(out.code.size());
+            out.code.push_back({BOp::Jump, 0, 0, static_cast<uint16_t>(quad.a.id())});
+            break;
+        case Opcode::Param: out.code.push_back({BOp::Param, reg(quad.a)}); break;
+        case Opcode::Call:
+            if (module.symbols[quad.a.id()] != "printf") {
+                error = "the interpreter has no function '" + string(module.symbols[quad.a.id()]) + "'";
+                return false;
+            }
+            out.code.push_back({BOp::Printf, reg(quad.dst), static_cast<uint16_t>(quad.b.value)});
+            break;
+        case Opcode::Return:
+            out.code.push_back({BOp::Return, reg(quad.a.isNone() ? Operand::constant(0) : quad.a)});
+            break;
+        default:
+            if (isCompare(quad.op) && i + 1 < code.size() && code[i + 1].op == Opcode::IfNot &&
+                code[i + 1].a == quad.dst && quad.dst.kind == OperandKind::Temp && reads[quad.dst.id()] == 1) {
+                jumps.push_back(out.code.size());
+                out.code.push_back({jumpUnless(quad.op), reg(quad.a), reg(quad.b), static_cast<uint16_t>(code[++i].b.id())});
+                break;
+            }
+            out.code.push_back({arithmetic(quad.op), reg(quad.dst), reg(quad.a), reg(quad.b)});
+            break;
+        }
+    }
+    // Falling off the end returns 0
+    out.code.push_back({BOp::Return, reg(Operand::constant(0))});
+    for (uint32_t j : jumps) out.code[j].c = static_cast<uint16_t>(labelAt[out.code[j].c]);
+
+    if (reg.overflow || out.code.size() > UINT16_MAX || function.labels.size() > UINT16_MAX) {
+        error = "function '" + string(function.name) + "' is too large for the interpreter";
+        return false;
+    }
+    return true;
+}
+
+bool compileBytecode(const IRModule& module, BytecodeProgram& program, string& error) {
+    program = BytecodeProgram();
+    vector<uint32_t> stringAddresses(module.strings.size());
+    string bytes;
+    for (size_t i = 0; i < module.strings.size(); ++i) {
+        stringAddresses[i] = program.data.size();
+        decodeLiteral(module.strings[i], bytes);
+        program.data += bytes;
+        program.data += '\0';
+    }
+    program.entry = UINT32_MAX;
+    program.functions.resize(module.functions.size());
+    for (size_t i = 0; i < module.functions.size(); ++i) {
+        if (!compileFunction(module, module.functions[i], stringAddresses, program.functions[i], error)) return false;
+        if (module.functions[i].name == "main") program.entry = i;
+    }
+    if (program.entry == UINT32_MAX) {
+        error = "no function 'main' to run";
+        return false;
+    }
+    return true;
+}
+
+// Appends one conversion formatted by snprintf, however long it comes out
+template <typename T> static void appendFormatted(string& output, const string& spec, T argument) {
+    char buffer[64];
+    int length = snprintf(buffer, sizeof(buffer), spec.c_str(), argument);
+    if (length < 0) return;
+    if (length < static_cast<int>(sizeof(buffer))) {
+        output.append(buffer, length);
+        return;
+    }
+    size_t at = output.size();
+    output.resize(at + length + 1);
+    snprintf(&output[at], length + 1, spec.c_str(), argument);
+    output.pop_back();
+}
+
+// printf over 32-bit arguments: %s takes a string address, every other
+// integer conversion an int, so length modifiers are dropped. Missing
+// arguments read as 0; conversions with no int meaning are copied as text.
+static int32_t builtinPrintf(const BytecodeProgram& program, const int32_t* arguments, size_t count, string& output) {
+    auto text = [&](int32_t address) -> const char* {
+        uint32_t offset = static_cast<uint32_t>(address) - static_cast<uint32_t>(stringBase);
+        return offset < program.data.size() ? program.data.c_str() + offset : nullptr;
+    };
+    const char* format = count ? text(arguments[0]) : nullptr;
+    if (!format) return -1;
+    size_t start = output.size();
+    size_t next = 1;
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%') {
+            output += *p;
+            continue;
+        }
+        string spec = "%";
+        const char* q = p + 1;
+        while (*q && strchr("-+ #0123456789.", *q)) spec += *q++;
+        while (*q && strchr("hlLqjzt", *q)) q++;
+        if (!*q) break;
+        p = q;
+        spec += *q;
+        int32_t argument = next < count ? arguments[next] : 0;
+        if (*q == '%') {
+            output += '%';
+        } else if (strchr("diouxXc", *q)) {
+            appendFormatted(output, spec, argument);
+            next++;
+        } else if (*q == 's') {
+            const char* string = text(argument);
+            appendFormatted(output, spec, string ? string : "(null)");
+            next++;
+        } else {
+            output += spec;
+        }
+    }
+    return static_cast<int32_t>(output.size() - start);
+}
+
+#if defined(__GNUC__) && !defined(F4_VM_SWITCH)
+#define F4_VM_THREADED 1
+#endif
+
+void interpret(const BytecodeProgram& program, InterpretResult& result) {
+    result = InterpretResult();
+    const BytecodeFunction& function = program.functions[program.entry];
+    vector<int32_t> registers = function.registers;
+    vector<int32_t> arguments;
+    int32_t* r = registers.data();
+    const BInstr* code = function.code.data();
+    const BInstr* ip = code;
+    // Executed instructions are counted a straight run at a time, at each
+    // jump and at the return, to keep the count out of the handlers
+    const BInstr* run = code;
+    const char* error = nullptr;
+
+#define JUMP(target)                                     \
+    {                                                    \
+        result.instructions += ip - run + 1;             \
+        ip = run = code + (target);                      \
+        NEXT();                                          \
+    }
+#define BINARY(name, expression)                         \
+    HANDLER(name) {                                      \
+        uint32_t x = r[ip->b], y = r[ip->c];             \
+        r[ip->a] = static_cast<int32_t>(expression);     \
+        ip++;                                            \
+        NEXT();                                          \
+    }
+#define COMPARE(name, op)                                \
+    HANDLER(name) {                                      \
+        r[ip->a] = r[ip->b] op r[ip->c];                 \
+        ip++;                                            \
+        NEXT();                                          \
+    }
+#define JUMP_UNLESS(name, op)                            \
+    HANDLER(name) {                                      \
+        if (r[ip->a] op r[ip->b]) {                      \
+            ip++;                                        \
+            NEXT();                                      \
+        }                                                \
+        JUMP(ip->c);                                     \
+    }
+#define DIVIDE(name, expression)                         \
+    HANDLER(name) {                                      \
+        int32_t x = r[ip->b], y = r[ip->c];              \
+        if (y == 0 || (x == INT_MIN && y == -1)) {       \
+            error = y == 0 ? "division by zero" : "division overflow"; \
+            goto stop;                                   \
+        }                                                \
+        r[ip->a] = expression;                           \
+        ip++;                                            \
+        NEXT();                                          \
+    }
+
+#ifdef F4_VM_THREADED
+    // In BOp order
+    static const void* const handlers[] = {
+        &&op_Move, &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Mod,
+        &&op_Eq, &&op_Ne, &&op_Lt, &&op_Le, &&op_Gt, &&op_Ge,
+        &&op_JumpUnlessEq, &&op_JumpUnlessNe, &&op_JumpUnlessLt,
+        &&op_JumpUnlessLe, &&op_JumpUnlessGt, &&op_JumpUnlessGe,
+        &&op_JumpUnless, &&op_Jump, &&op_Param, &&op_Printf, &&op_Return,
+    };
+#define NEXT() goto *handlers[static_cast<size_t>(ip->op)]
+#define HANDLER(name) op_##name:
+    NEXT();
+    {
+#else
+#define NEXT() continue
+#define HANDLER(name) case BOp::name:
+    for (;;) switch (ip->op) {
+#endif
+    HANDLER(Move) {
+        r[ip->a] = r[ip->b];
+        ip++;
+        NEXT();
+    }
+    // Wrapping arithmetic, as in the generated code
+    BINARY(Add, x + y)
+    BINARY(Sub, x - y)
+    BINARY(Mul, x * y)
+    DIVIDE(Div, x / y)
+    DIVIDE(Mod, x % y)
+    COMPARE(Eq, ==)
+    COMPARE(Ne, !=)
+    COMPARE(Lt, <)
+    COMPARE(Le, <=)
+    COMPARE(Gt, >)
+    COMPARE(Ge, >=)
+    JUMP_UNLESS(JumpUnlessEq, ==)
+    JUMP_UNLESS(JumpUnlessNe, !=)
+    JUMP_UNLESS(JumpUnlessLt, <)
+    JUMP_UNLESS(JumpUnlessLe, <=)
+    JUMP_UNLESS(JumpUnlessGt, >)
+    JUMP_UNLESS(JumpUnlessGe, >=)
+    HANDLER(JumpUnless) {
+        if (r[ip->a]) {
+            ip++;
+            NEXT();
+        }
+        JUMP(ip->c);
+    }
+    HANDLER(Jump) JUMP(ip->c);
+    HANDLER(Param) {
+        arguments.push_back(r[ip->a]);
+        ip++;
+        NEXT();
+    }
+    HANDLER(Printf) {
+        // The last b arguments are this call's
+        size_t first = arguments.size() - ip->b;
+        r[ip->a] = builtinPrintf(program, arguments.data() + first, ip->b, result.output);
+        arguments.resize(first);
+        ip++;
+        NEXT();
+    }
+    HANDLER(Return) {
+        result.instructions += ip - run + 1;
+        result.completed = true;
+        result.returnValue = r[ip->a];
+        return;
+    }
+    }
+
+stop:
+    result.instructions += ip - run + 1;
+    result.error = error;
+
+#undef JUMP
+#undef BINARY
+#undef COMPARE
+#undef JUMP_UNLESS
+#undef DIVIDE
+#undef NEXT
+#undef HANDLER
+}
+
+string formatBytecode(const BInstr& instr) {
+    static const char* const names[] = {"move", "add", "sub", "mul", "div", "mod", "eq", "ne", "lt", "le", "gt", "ge",
+                                        "jumpunless.eq", "jumpunless.ne", "jumpunless.lt", "jumpunless.le",
+                                        "jumpunless.gt", "jumpunless.ge", "jumpunless", "jump", "param", "printf",
+                                        "return"};
+    auto reg = [](uint16_t index) { return "r" + to_string(index); };
+    string line = names[static_cast<int>(instr.op)];
+    switch (instr.op) {
+    case BOp::Move: return line + " " + reg(instr.a) + ", " + reg(instr.b);
+    case BOp::JumpUnless: return line + " " + reg(instr.a) + ", @" + to_string(instr.c);
+    case BOp::Jump: return line + " @" + to_string(instr.c);
+    case BOp::Param:
+    case BOp::Return: return line + " " + reg(instr.a);
+    case BOp::Printf: return line + " " + reg(instr.a) + ", " + to_string(instr.b);
+    default:
+        if (instr.op >= BOp::JumpUnlessEq) return line + " " + reg(instr.a) + ", " + reg(instr.b) + ", @" + to_string(instr.c);
+        return line + " " + reg(instr.a) + ", " + reg(instr.b) + ", " + reg(instr.c);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ir.hpp"
+using namespace std;
+
+// Register bytecode for interpreting a module without going through
+// machine code. Every operand is a register: constants and string
+// addresses are registers preloaded with their value, so an instruction
+// never has to ask what kind of operand it has.
+
+enum class BOp : uint16_t {
+    Move,                         // a = b
+    Add, Sub, Mul, Div, Mod,      // a = b op c
+    Eq, Ne, Lt, Le, Gt, Ge,       // a = b op c, 1 or 0
+    JumpUnlessEq, JumpUnlessNe, JumpUnlessLt, // unless a op b, go to c: a compare
+    JumpUnlessLe, JumpUnlessGt, JumpUnlessGe, // fused with the ifnot reading it
+    JumpUnless,                   // unless a, go to c
+    Jump,                         // go to c
+    Param,                        // next call argument a
+    Printf,                       // a = printf(arguments), b = argument count
+    Return                        // return a
+};
+
+// Registers and jump targets are 16-bit, so a function is limited to
+// 65536 of each
+struct BInstr {
+    BOp op;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+};
+
+struct BytecodeFunction {
+    string_view name;
+    vector<BInstr> code;
+    vector<int32_t> registers; // initial values: constants set, the rest 0
+};
+
+// String literals live at addresses from stringBase in the program's data
+const int32_t stringBase = 0x1000;
+
+struct BytecodeProgram {
+    vector<BytecodeFunction> functions;
+    uint32_t entry = 0; // index of main
+    string data;        // the literals, decoded and NUL-terminated
+};
+
+// Fails, with a message, on calls to anything but printf and on
+// functions too large for 16-bit registers and targets
+bool compileBytecode(const IRModule& module, BytecodeProgram& program, string& error);
+
+struct InterpretResult {
+    bool completed = false; // main returned
+    int32_t returnValue = 0;
+    string output;          // what printf wrote
+    string error;           // the runtime error that stopped it
+    size_t instructions = 0; // executed
+};
+
+// Threaded dispatch: each handler jumps straight to the next one through
+// a computed goto where the compiler supports it (GCC and Clang), rather
+// than returning to a central switch
+void interpret(const BytecodeProgram& program, InterpretResult& result);
+
+string formatBytecode(const BInstr& instr);
+
+#endif // VM_HPP
@@ -0,0 +1,188 @@
+#include "x86.hpp"
+
+const char* regName(Reg reg) {
+    static const char* const names[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d",
+                                        "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d", "?"};
+    return names[static_cast<int>(reg)];
+}
+
+const char* regWideName(Reg reg) {
+    static const char* const names[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8",
+                                        "r9", "r10", "r11", "r12", "r13", "r14", "r15", "?"};
+    return names[static_cast<int>(reg)];
+}
+
+const char* regByteName(Reg reg) {
+    static const char* const names[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b",
+                                        "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b", "?"};
+    return names[static_cast<int>(reg)];
+}
+
+static uint16_t regMask(initializer_list<Reg> regs) {
+    uint16_t mask = 0;
+    for (Reg reg : regs) mask |= regBit(reg);
+    return mask;
+}
+
+const CallingConvention& callingConvention(Target target) {
+    // cdecl: a call may clobber eax, ecx and edx
+    static const CallingConvention x86 = {
+        Target::X86, 4,
+        {Reg::ECX, Reg::EDX, Reg::EBX, Reg::ESI, Reg::EDI},
+        regMask({Reg::EAX, Reg::ECX, Reg::EDX}),
+        regMask({Reg::EBX, Reg::ESI, Reg::EDI}),
+        {},
+    };
+    // System V AMD64: rbx and r12-r15 survive calls; arguments go in rdi,
+    // rsi, rdx, rcx, r8 and r9
+    static const CallingConvention x64 = {
+        Target::X64, 8,
+        {Reg::ECX, Reg::EDX, Reg::ESI, Reg::EDI, Reg::R8, Reg::R9, Reg::R10, Reg::R11,
+         Reg::EBX, Reg::R12, Reg::R13, Reg::R14, Reg::R15},
+        regMask({Reg::EAX, Reg::ECX, Reg::EDX, Reg::ESI, Reg::EDI, Reg::R8, Reg::R9, Reg::R10, Reg::R11}),
+        regMask({Reg::EBX, Reg::R12, Reg::R13, Reg::R14, Reg::R15}),
+        {Reg::EDI, Reg::ESI, Reg::EDX, Reg::ECX, Reg::R8, Reg::R9},
+    };
+    return target == Target::X64 ? x64 : x86;
+}
+
+const char* condName(Cond cond) {
+    static const char* const names[] = {"e", "ne", "l", "le", "g", "ge"};
+    return names[static_cast<int>(cond)];
+}
+
+Cond negate(Cond cond) {
+    switch (cond) {
+        case Cond::E: return Cond::NE;
+        case Cond::NE: return Cond::E;
+        case Cond::L: return Cond::GE;
+        case Cond::LE: return Cond::G;
+        case Cond::G: return Cond::LE;
+        default: return Cond::L;
+    }
+}
+
+Cond swapOperands(Cond cond) {
+    switch (cond) {
+        case Cond::L: return Cond::G;
+        case Cond::LE: return Cond::GE;
+        case Cond::G: return Cond::L;
+        case Cond::GE: return Cond::LE;
+        default: return cond;
+    }
+}
+
+static const char* mnemonic(MOp op) {
+    switch (op) {
+        case MOp::Mov: return "mov";
+        case MOp::Movzx: return "movzx";
+        case MOp::Lea: return "lea";
+        case MOp::Add: return "add";
+        case MOp::Sub: return "sub";
+        case MOp::Imul: return "imul";
+        case MOp::Neg: return "neg";
+        case MOp::Cdq: return "cdq";
+        case MOp::Idiv: return "idiv";
+        case MOp::And: return "and";
+        case MOp::Xor: return "xor";
+        case MOp::Shl: return "shl";
+        case MOp::Sar: return "sar";
+        case MOp::Shr: return "shr";
+        case MOp::Cmp: return "cmp";
+        case MOp::Test: return "test";
+        case MOp::Jmp: return "jmp";
+        case MOp::Call: return "call";
+        case MOp::Push: return "push";
+        case MOp::Pop: return "pop";
+        case MOp::Ret: return "ret";
+        default: return "";
+    }
+}
+
+// On Windows C symbols get a leading underscore (cdecl decoration)
+string symbolName(string_view name, Target target) {
+    return target == Target::X86 ? "_" + string(name) : string(name);
+}
+
+static string labelName(const MFunction& function, int32_t id) {
+    if (static_cast<uint32_t>(id) == function.exitLabel) return ".Lexit_" + symbolName(function.name, function.target);
+    return ".L" + to_string(id + 1);
+}
+
+// Register operand widths: byte for setcc and movzx, 64-bit for x86-64
+// pointers (the stack and frame registers, pushes and pops, addresses)
+enum class Width { Byte, Dword, Qword };
+
+static string operandText(const IRModule& module, const MFunction& function, const MOperand& operand, Width width) {
+    bool x64 = function.target == Target::X64;
+    auto addressRegister = [&](Reg reg) { return x64 ? regWideName(reg) : regName(reg); };
+    switch (operand.kind) {
+    case MKind::Reg:
+        if (width == Width::Byte) return regByteName(operand.base);
+        if (width == Width::Qword || operand.base == Reg::ESP || operand.base == Reg::EBP) {
+            return addressRegister(operand.base);
+        }
+        return regName(operand.base);
+    case MKind::Imm: return to_string(operand.value);
+    case MKind::Mem: {
+        string text = "[";
+        if (operand.base != Reg::None) text += addressRegister(operand.base);
+        if (operand.index != Reg::None) {
+            if (text.size() > 1) text += "+";
+            text += addressRegister(operand.index);
+            if (operand.scale != 1) text += "*" + to_string(operand.scale);
+        }
+        if (operand.value != 0 || text.size() == 1) {
+            if (operand.value >= 0 && text.size() > 1) text += "+";
+            text += to_string(operand.value);
+        }
+        return text + "]";
+    }
+    case MKind::Label: return labelName(function, operand.value);
+    case MKind::Symbol: return symbolName(module.symbols[operand.value], function.target);
+    case MKind::String: return "LC" + to_string(operand.value);
+    default: return "";
+    }
+}
+
+string formatInstr(const IRModule& module, const MFunction& function, const MInstr& instr) {
+    bool x64 = function.target == Target::X64;
+    // Pushes and pops move whole stack slots, and lea of a string yields
+    // a pointer
+    bool wide = x64 && (instr.op == MOp::Push || instr.op == MOp::Pop ||
+                        (instr.op == MOp::Lea && instr.src.kind == MKind::String));
+    auto text = [&](const MOperand& operand, Width width = Width::Dword) {
+        return operandText(module, function, operand, wide && width == Width::Dword ? Width::Qword : width);
+    };
+    switch (instr.op) {
+    case MOp::Label: return text(instr.dst) + ":";
+    case MOp::Jcc: return "j" + string(condName(instr.cond)) + " " + text(instr.dst);
+    case MOp::Setcc: return "set" + string(condName(instr.cond)) + " " + text(instr.dst, Width::Byte);
+    case MOp::Movzx: return "movzx " + text(instr.dst) + ", " + text(instr.src, Width::Byte);
+    case MOp::Lea:
+        // x86-64 takes string addresses relative to rip
+        if (x64 && instr.src.kind == MKind::String) return "lea " + text(instr.dst) + ", [rel " + text(instr.src) + "]";
+        break;
+    case MOp::Call: {
+        // Functions outside the module are reached through the PLT
+        string line = "call " + text(instr.dst);
+        if (!x64) return line;
+        for (const IRFunction& defined : module.functions) {
+            if (defined.name == module.symbols[instr.dst.value]) return line;
+        }
+        return line + " wrt ..plt";
+    }
+    default: break;
+    }
+    string line = mnemonic(instr.op);
+    if (instr.dst.isNone()) return line;
+    // Without a register operand the assembler needs the operand size
+    bool sized = instr.op != MOp::Lea && !instr.dst.isReg() && !instr.src.isReg() &&
+                 (instr.dst.kind == MKind::Mem || instr.src.kind == MKind::Mem || instr.dst.kind == MKind::Imm);
+    if (sized) line += wide ? " qword " : " dword ";
+    else line += " ";
+    line += text(instr.dst);
+    if (!instr.src.isNone()) line += ", " + text(instr.src);
+    if (!instr.src2.isNone()) line += ", " + text(instr.src2);
+    return line;
+}
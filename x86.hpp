@@ -0,0 +1,112 @@
+#ifndef X86_HPP
+#define X86_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ir.hpp"
+using namespace std;
+
+// x86 code in structured form. Code generation builds these and later
+// stages rewrite them before they are printed as NASM text.
+
+// Hardware encoding order; r8-r15 exist only on x86-64
+enum class Reg : uint8_t { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI, R8, R9, R10, R11, R12, R13, R14, R15, None };
+
+inline uint16_t regBit(Reg reg) { return static_cast<uint16_t>(1u << static_cast<unsigned>(reg)); }
+const char* regName(Reg reg);     // 32-bit: eax, r8d
+const char* regWideName(Reg reg); // 64-bit: rax, r8
+const char* regByteName(Reg reg); // al, r8b; 32-bit code has only al to bl
+
+// Values are 32-bit on both targets. X86 is i386 cdecl with Win32 symbol
+// names; X64 is x86-64 System V (Linux), which computes on the low halves
+// of its registers and uses full ones only for the stack and addresses.
+enum class Target : uint8_t { X86, X64 };
+
+// Register usage of a target's calling convention. eax is never handed
+// out: it carries return values and the dividend of idiv, and instruction
+// selection uses it as scratch when an instruction cannot take its
+// operands where they are.
+struct CallingConvention {
+    Target target;
+    uint32_t wordSize;          // bytes of a push, a return address or a saved register
+    vector<Reg> allocatable;    // in the order handed out, caller-saved first
+    uint16_t callerSaved;       // regBit() masks
+    uint16_t calleeSaved;       // besides ebp, which the frame saves
+    vector<Reg> argumentRegisters; // for the leading arguments; the rest are pushed
+};
+
+const CallingConvention& callingConvention(Target target);
+
+enum class Cond : uint8_t { E, NE, L, LE, G, GE };
+
+const char* condName(Cond cond);
+Cond negate(Cond cond);
+Cond swapOperands(Cond cond); // condition after exchanging the cmp operands
+
+enum class MOp : uint8_t {
+    Mov, Movzx, Lea,
+    Add, Sub, Imul, Neg, Cdq, Idiv,
+    And, Xor, Shl, Sar, Shr,
+    Cmp, Test, Setcc,
+    Jmp, Jcc, Call, Push, Pop, Ret,
+    Label
+};
+
+enum class MKind : uint8_t {
+    None,
+    Reg,
+    Imm,
+    Mem,     // [base + index*scale + value]
+    Label,   // jump target, see MFunction::exitLabel
+    Symbol,  // called function, index into IRModule::symbols
+    String   // address of a string literal
+};
+
+struct MOperand {
+    MKind kind = MKind::None;
+    Reg base = Reg::None;  // Reg operand, or Mem base
+    Reg index = Reg::None;
+    uint8_t scale = 1;
+    int32_t value = 0;     // immediate, displacement, or label, symbol or string ID
+
+    static MOperand reg(Reg r) { MOperand o; o.kind = MKind::Reg; o.base = r; return o; }
+    static MOperand imm(int32_t v) { MOperand o; o.kind = MKind::Imm; o.value = v; return o; }
+    static MOperand mem(Reg base, int32_t disp) { MOperand o; o.kind = MKind::Mem; o.base = base; o.value = disp; return o; }
+    static MOperand label(uint32_t id) { MOperand o; o.kind = MKind::Label; o.value = id; return o; }
+    static MOperand symbol(uint32_t id) { MOperand o; o.kind = MKind::Symbol; o.value = id; return o; }
+    static MOperand string(uint32_t id) { MOperand o; o.kind = MKind::String; o.value = id; return o; }
+
+    bool isNone() const { return kind == MKind::None; }
+    bool isReg() const { return kind == MKind::Reg; }
+    bool isReg(Reg r) const { return kind == MKind::Reg && base == r; }
+    bool isMem() const { return kind == MKind::Mem; }
+    // Immediates and string addresses are both constants to the assembler
+    bool isConstant() const { return kind == MKind::Imm || kind == MKind::String; }
+    bool operator==(const MOperand& other) const {
+        return kind == other.kind && base == other.base && index == other.index && scale == other.scale &&
+               value == other.value;
+    }
+    bool operator!=(const MOperand& other) const { return !(*this == other); }
+};
+
+struct MInstr {
+    MOp op;
+    Cond cond = Cond::E; // Setcc and Jcc
+    MOperand dst;
+    MOperand src;
+    MOperand src2; // immediate of the three-operand imul
+};
+
+struct MFunction {
+    string_view name;
+    Target target = Target::X86;
+    vector<MInstr> code;
+    uint32_t exitLabel = 0; // label of the shared epilogue
+};
+
+string symbolName(string_view name, Target target);
+string formatInstr(const IRModule& module, const MFunction& function, const MInstr& instr);
+
+#endif // X86_HPP